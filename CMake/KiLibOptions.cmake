@@ -8,6 +8,7 @@ function(SetKiLibOptions target)
     set(BUILD_SHARED_LIBS OFF)
 
     _SetKiLibWarnings(${target})
+    _SetKiLibMath(${target})
     _SetKiLibIPO(${target})
     _SetKiLibLogLevel(${target})
 endfunction()
@@ -30,6 +31,16 @@ function(_SetKiLibWarnings target)
     endif()
 endfunction()
 
+# Function that sets floating point flags
+function(_SetKiLibMath target)
+    # Nothing in KiLib reads errno, so math functions need not set it. This lets loops calling sqrt and friends
+    # vectorize without changing any result. Nothing enables floating point traps either, so guarded arithmetic and
+    # floor may be evaluated speculatively, which the batched interpolation relies on to vectorize.
+    if (KILIB_COMPILER_IS_GNU_LIKE)
+        target_compile_options(${target} PRIVATE -fno-math-errno -fno-trapping-math)
+    endif()
+endfunction()
+
 function(_SetKiLibIPO target)
     # If KILIB_BUILD_IPO is set then enable interprocedural optimization
     if (KILIB_BUILD_IPO)
@@ -22,6 +22,7 @@
 #include <KiLib/Hydrology/Hydrology.hpp>
 #include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 using namespace KiLib::Hydrology;
 
@@ -36,4 +37,38 @@ double TopModel::ComputeWetness(
 {
    return std::clamp(rainfall / (ks * thickness) * std::exp(twi), 0.0, 1.0);
 }
+
+KiLib::Raster TopModel::ComputeWetness(
+   const double rainfall,               // Rainfall intensity [L/T]
+   const KiLib::RasterView &ks,         // Hydraulic conductivity [L/T]
+   const KiLib::RasterView &thickness,  // Soil thickness [L]
+   const KiLib::RasterView &twi) const  // Topographic Wetness Index [-]
+{
+   if (ks.nRows != twi.nRows || ks.nCols != twi.nCols || thickness.nRows != twi.nRows || thickness.nCols != twi.nCols)
+      throw std::invalid_argument("ks, thickness and twi rasters must have the same size");
+
+   KiLib::Raster wetness = KiLib::Raster::emptyLike(twi);
+   const double  nodata  = twi.nodata_value;
+   const long    nRows   = static_cast<long>(twi.nRows);
+   const size_t  nCols   = twi.nCols;
+
+#pragma omp parallel for
+   for (long r = 0; r < nRows; r++)
+   {
+      const double *k   = &ks(r, 0);
+      const double *h   = &thickness(r, 0);
+      const double *w   = &twi(r, 0);
+      double       *out = &wetness(r, 0);
+#pragma omp simd
+      for (size_t c = 0; c < nCols; c++)
+      {
+         // Same as the scalar overload, with selects instead of std::clamp so the loop vectorizes
+         const double value   = rainfall / (k[c] * h[c]) * std::exp(w[c]);
+         const double clamped = value < 0.0 ? 0.0 : value > 1.0 ? 1.0 : value;
+         const bool   missing = (k[c] == ks.nodata_value) | (h[c] == thickness.nodata_value) | (w[c] == nodata);
+         out[c]               = missing ? nodata : clamped;
+      }
+   }
+   return wetness;
+}
 // clang-format on
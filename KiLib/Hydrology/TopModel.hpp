@@ -21,6 +21,7 @@
 #pragma once
 
 #include <KiLib/Hydrology/BaseHydrology.hpp>
+#include <KiLib/Raster/Raster.hpp>
 
 namespace KiLib::Hydrology
 {
@@ -35,6 +36,13 @@ namespace KiLib::Hydrology
          const double ks,         // Hydraulic conductivity [L/T]
          const double thickness,      // Soil thickness [L]
          const double twi) const; // Topographic Wetness Index [-]
+
+      // Wetness of every cell in one parallel pass, nodata where any raster has nodata. Rasters must have the same size.
+      KiLib::Raster ComputeWetness(
+         const double rainfall,               // Rainfall intensity [L/T]
+         const KiLib::RasterView &ks,         // Hydraulic conductivity [L/T]
+         const KiLib::RasterView &thickness,  // Soil thickness [L]
+         const KiLib::RasterView &twi) const; // Topographic Wetness Index [-], from ComputeTopographicWetnessIndex
       // clang-format on
    };
 } // namespace KiLib::Hydrology
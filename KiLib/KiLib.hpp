@@ -45,7 +45,14 @@
 #include <KiLib/Exceptions/NotImplemented.hpp>
 
 // Raster
+#include <KiLib/Raster/Flow.hpp>
+#include <KiLib/Raster/Focal.hpp>
+#include <KiLib/Raster/MappedRaster.hpp>
 #include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Raster/RasterView.hpp>
+#include <KiLib/Raster/StreamIndex.hpp>
+#include <KiLib/Raster/SummedAreaTable.hpp>
+#include <KiLib/Raster/ValidityMask.hpp>
 
 // Soils
 #include <KiLib/Soils/Soils.hpp>
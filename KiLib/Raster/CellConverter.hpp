@@ -0,0 +1,172 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+namespace KiLib
+{
+   /**
+    * @brief Converts cells of type S into cells of type T without casting values T cannot represent. Every reader,
+    * writer and converting constructor goes through it when the cell types differ.
+    *
+    * Cells equal to the nodata value become the nodata cell of T. If T cannot hold the nodata value exactly but the
+    * samples can (or may be NaN), it is replaced by a sentinel, the largest value of unsigned types and the lowest of
+    * the others, and nodata() returns the new value to store in nodata_value. Other values saturate to the range of T
+    * (integers are truncated toward zero) and never land on the nodata cell: a value that would is moved one step
+    * away from it. NaN becomes nodata in integer types.
+    *
+    * @tparam S Type of the input cells
+    * @tparam T Type of the output cells
+    */
+   template <class S, class T>
+   class CellConverter
+   {
+   public:
+      /**
+       * @param nodata Nodata value of the input cells
+       */
+      explicit CellConverter(double nodata) : nodataValue(nodata)
+      {
+         this->matchNodata = Holds<S>(nodata);
+         if (this->matchNodata)
+            this->inputNodata = static_cast<S>(nodata);
+
+         if (Holds<T>(nodata))
+         {
+            this->hasNodata    = true;
+            this->outputNodata = static_cast<T>(nodata);
+         }
+         else if (this->matchNodata || std::is_floating_point_v<S>)
+         {
+            this->hasNodata = true;
+            this->outputNodata =
+               std::is_signed_v<T> ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+         }
+
+         // Floating point nodata values are stored as the cells hold them, so comparing cells to it is exact
+         if (this->hasNodata)
+            this->nodataValue = static_cast<double>(this->outputNodata);
+      }
+
+      /**
+       * @brief Nodata value of the converted cells
+       */
+      double nodata() const
+      {
+         return this->nodataValue;
+      }
+
+      /**
+       * @brief Nodata value as an output cell, or T() if T cannot hold it and no input cell is nodata
+       */
+      T nodataCell() const
+      {
+         return this->outputNodata;
+      }
+
+      /**
+       * @brief Converts one cell
+       */
+      T operator()(S value) const
+      {
+         if constexpr (std::is_same_v<S, T>)
+         {
+            return value;
+         }
+         else
+         {
+            if constexpr (std::is_floating_point_v<S>)
+            {
+               if (std::isnan(value))
+                  return std::is_floating_point_v<T> ? std::numeric_limits<T>::quiet_NaN() : this->outputNodata;
+            }
+            if (this->matchNodata && value == this->inputNodata)
+               return this->outputNodata;
+
+            constexpr T  lowest = std::numeric_limits<T>::lowest();
+            constexpr T  max    = std::numeric_limits<T>::max();
+            const double x      = static_cast<double>(value);
+            T            out;
+
+            if constexpr (std::is_integral_v<T>)
+            {
+               // max + 1 is exact in double for every integer type, unlike max for 64-bit types
+               if (x < static_cast<double>(lowest))
+                  out = lowest;
+               else if (x >= static_cast<double>(max) + 1.0)
+                  out = max;
+               else
+                  out = static_cast<T>(x);
+            }
+            else
+            {
+               out = std::isfinite(x) ? static_cast<T>(std::clamp(x, double(lowest), double(max))) : static_cast<T>(x);
+            }
+
+            if (this->hasNodata && out == this->outputNodata)
+            {
+               const bool down = (x < this->nodataValue && out != lowest) || out == max;
+               if constexpr (std::is_integral_v<T>)
+                  out = static_cast<T>(down ? out - 1 : out + 1);
+               else
+                  out = std::nextafter(out, down ? lowest : max);
+            }
+            return out;
+         }
+      }
+
+      /**
+       * @brief Converts n contiguous cells
+       */
+      void operator()(const S *in, T *out, size_t n) const
+      {
+         if constexpr (std::is_same_v<S, T>)
+            std::copy(in, in + n, out);
+         else
+            for (size_t i = 0; i < n; i++)
+               out[i] = this->operator()(in[i]);
+      }
+
+   private:
+      double nodataValue;
+      bool   matchNodata  = false; // Whether S can hold the nodata value
+      S      inputNodata  = S();   // Nodata value as an input cell, if S can hold it
+      bool   hasNodata    = false; // Whether outputNodata is the nodata value of the output
+      T      outputNodata = T();
+
+      // Whether U holds value exactly (floating point types: within their range, rounding allowed)
+      template <class U>
+      static bool Holds(double value)
+      {
+         if constexpr (std::is_floating_point_v<U>)
+            return !std::isfinite(value) ||
+                   (value >= std::numeric_limits<U>::lowest() && value <= std::numeric_limits<U>::max());
+         else
+            return value >= static_cast<double>(std::numeric_limits<U>::lowest()) &&
+                   value < static_cast<double>(std::numeric_limits<U>::max()) + 1.0 && std::trunc(value) == value;
+      }
+   };
+} // namespace KiLib
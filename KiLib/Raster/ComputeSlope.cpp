@@ -1,78 +1,237 @@
+#include <KiLib/Raster/Focal.hpp>
 #include <KiLib/Raster/Raster.hpp>
+#include <array>
+#include <cmath>
 #include <functional>
 #include <map>
 
-namespace KiLib
+// Based on Zevenbergen, L.W. and Thorne, C.R. (1987), Quantitative analysis of land surface topography. Earth Surf.
+// Process. Landforms, 12: 47-56. https://doi.org/10.1002/esp.3290120107
+// Central differences over the 4 adjacent cells, one sided differences when one of them is missing.
+struct _ZevenbergenThorneSlope
 {
-   static const auto EnumToSlope =
-      std::map<KiLib::Raster::SlopeMethod, std::function<KiLib::Raster(const KiLib::Raster &)>>{
-         {KiLib::Raster::SlopeMethod::ZevenbergenThorne, KiLib::Raster::ComputeSlopeZevenbergenThorne},
-      };
+   static constexpr int radius = 1;
+   double               cellsize;
 
-   KiLib::Raster KiLib::Raster::ComputeSlope(KiLib::Raster::SlopeMethod method) const
+   template <class W>
+   double operator()(const W &z) const
    {
-      return EnumToSlope.at(method)(*this);
+      // Missing neighbours already hold the centre value
+      const double xDiv = cellsize * 2 / (z.valid(0, -1) ? 1 : 2) / (z.valid(0, 1) ? 1 : 2);
+      const double yDiv = cellsize * 2 / (z.valid(-1, 0) ? 1 : 2) / (z.valid(1, 0) ? 1 : 2);
+      const double g    = (-z(0, -1) + z(0, 1)) / xDiv; // Eqn 9
+      const double h    = (z(-1, 0) - z(1, 0)) / yDiv;  // Eqn 10
+      return std::sqrt(g * g + h * h);                 // Eqn 13
    }
+};
 
-   // Based on Zevenbergen, L.W. and Thorne, C.R. (1987), Quantitative analysis of land surface topography. Earth Surf.
-   // Process. Landforms, 12: 47-56. https://doi.org/10.1002/esp.3290120107
-   KiLib::Raster KiLib::Raster::ComputeSlopeZevenbergenThorne(const KiLib::Raster &inp)
+// Horn, B.K.P. (1981), Hill shading and the reflectance map. Proceedings of the IEEE, 69(1): 14-47.
+// https://doi.org/10.1109/PROC.1981.11918
+// Third-order finite differences weighting the adjacent cells twice, as used by ArcGIS and GDAL.
+struct _HornSlope
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   double operator()(const W &z) const
    {
-      KiLib::Raster slope = KiLib::Raster::fillLike(inp, 0.0, true);
+      const double dx = ((z(1, 1) + 2 * z(0, 1) + z(-1, 1)) - (z(1, -1) + 2 * z(0, -1) + z(-1, -1))) / (8 * cellsize);
+      const double dy = ((z(1, -1) + 2 * z(1, 0) + z(1, 1)) - (z(-1, -1) + 2 * z(-1, 0) + z(-1, 1))) / (8 * cellsize);
+      return std::sqrt(dx * dx + dy * dy);
+   }
+};
 
-      double ND = inp.nodata_value;
-      int    NR = inp.nRows;
-      int    NC = inp.nCols;
+// Evans, I.S. (1979), An integrated system of terrain analysis and slope mapping. Final report on grant DA-ERO-591-73-
+// G0040, University of Durham. Also Young, M. (1978), Terrain analysis program documentation.
+// Least squares fit of a quadratic surface over the window, weighting all neighbours equally.
+struct _EvansYoungSlope
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   double operator()(const W &z) const
+   {
+      const double dx = ((z(1, 1) + z(0, 1) + z(-1, 1)) - (z(1, -1) + z(0, -1) + z(-1, -1))) / (6 * cellsize);
+      const double dy = ((z(1, -1) + z(1, 0) + z(1, 1)) - (z(-1, -1) + z(-1, 0) + z(-1, 1))) / (6 * cellsize);
+      return std::sqrt(dx * dx + dy * dy);
+   }
+};
 
-      // Slope over 4 adj points
-      auto getSlope = [&](const size_t r, const size_t c)
+// Steepest drop to any of the 8 neighbours (as used for D8 flow routing), 0 for pits and flats. Missing neighbours are
+// ignored.
+struct _MaxDownhillSlope
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   double operator()(const W &z) const
+   {
+      // Missing neighbours hold the centre value, so they never are the steepest drop. Selects by value, std::max
+      // returns references which keeps the loop of FocalApply from vectorizing.
+      auto         max  = [](double a, double b) { return a > b ? a : b; };
+      const double c    = z(0, 0);
+      const double diag = cellsize * std::sqrt(2.0);
+      const double card = max(max(c - z(1, 0), c - z(-1, 0)), max(c - z(0, -1), c - z(0, 1))) / cellsize;
+      const double diog = max(max(c - z(1, -1), c - z(1, 1)), max(c - z(-1, -1), c - z(-1, 1))) / diag;
+      return max(max(card, diog), 0.0);
+   }
+};
+
+// Zevenbergen and Thorne (1987) partial quartic surface: slope, aspect and curvatures from its coefficients. Aspect
+// calls atan2, which does not vectorize, so it is only computed when requested.
+template <bool withAspect>
+struct _ZevenbergenThorneDerivatives
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   std::array<double, 5> operator()(const W &z) const
+   {
+      // Same differences as _ZevenbergenThorneSlope, so slopes are identical
+      const double xDiv = cellsize * 2 / (z.valid(0, -1) ? 1 : 2) / (z.valid(0, 1) ? 1 : 2);
+      const double yDiv = cellsize * 2 / (z.valid(-1, 0) ? 1 : 2) / (z.valid(1, 0) ? 1 : 2);
+      const double L2   = cellsize * cellsize;
+
+      const double D = ((z(0, -1) + z(0, 1)) / 2 - z(0, 0)) / L2;
+      const double E = ((z(1, 0) + z(-1, 0)) / 2 - z(0, 0)) / L2;
+      const double F = (-z(1, -1) + z(1, 1) + z(-1, -1) - z(-1, 1)) / (4 * L2);
+      const double G = (-z(0, -1) + z(0, 1)) / xDiv; // Eqn 9, dz/dx
+      const double H = (z(1, 0) - z(-1, 0)) / yDiv;  // Eqn 10, dz/dy with y pointing north
+      const double P = G * G + H * H;
+
+      // Flats have no slope direction, their aspect is -1 and their profile and plan curvatures 0 (G = H = 0 zeroes
+      // the numerators, only the denominator needs guarding)
+      const bool   flat = P == 0;
+      const double Q    = flat ? 1 : P;
+
+      double aspect = -1;
+      if constexpr (withAspect)
       {
-         int r1 = r - 1;
-         int r2 = r + 1;
-         int c1 = c - 1;
-         int c2 = c + 1;
+         const double deg = std::atan2(-G, -H) * 180 / M_PI; // Downslope, clockwise from north
+         aspect           = flat ? -1 : (deg < 0 ? deg + 360 : deg);
+      }
 
-         double xDiv = inp.cellsize * 2;
-         double yDiv = inp.cellsize * 2;
+      return {
+         std::sqrt(P), // Eqn 13
+         aspect,
+         -2 * (D * G * G + E * H * H + F * G * H) / Q, // Profile
+         2 * (D * H * H + E * G * G - F * G * H) / Q,  // Plan
+         -2 * (D + E),                                 // Total
+      };
+   }
+};
 
-         if ((r1 < 0) or (inp.at(r1, c) == ND))
-         {
-            r1 = r;
-            yDiv /= 2;
-         }
-         if ((r2 > (NR - 1)) or (inp.at(r2, c) == ND))
-         {
-            r2 = r;
-            yDiv /= 2;
-         }
-         if ((c1 < 0) or (inp.at(r, c1) == ND))
-         {
-            c1 = c;
-            xDiv /= 2;
-         }
-         if ((c2 > (NC - 1)) or (inp.at(r, c2) == ND))
-         {
-            c2 = c;
-            xDiv /= 2;
-         }
-         double g = (-inp(r, c1) + inp(r, c2)) / xDiv; // Eqn 9
-         double h = (inp(r1, c) - inp(r2, c)) / yDiv;  // Eqn 10
-         return std::sqrt(g * g + h * h);              // Eqn 13
+namespace KiLib
+{
+   template <class T>
+   static const auto EnumToSlope = std::map<
+      typename BasicRaster<T>::SlopeMethod, std::function<BasicRaster<double>(const BasicRasterView<const T> &)>>{
+         {BasicRaster<T>::SlopeMethod::ZevenbergenThorne, BasicRaster<T>::ComputeSlopeZevenbergenThorne},
+         {BasicRaster<T>::SlopeMethod::Horn, BasicRaster<T>::ComputeSlopeHorn},
+         {BasicRaster<T>::SlopeMethod::EvansYoung, BasicRaster<T>::ComputeSlopeEvansYoung},
+         {BasicRaster<T>::SlopeMethod::MaxDownhill, BasicRaster<T>::ComputeSlopeMaxDownhill},
       };
 
-      for (int r = 0; r < NR; r++)
+   // Raster of doubles with the metadata of inp, every cell is meant to be written by FocalApply
+   template <class T>
+   static BasicRaster<double> _DoubleLike(const BasicRasterView<const T> &inp)
+   {
+      return BasicRaster<double>::fromMetadata(
+         inp.nRows, inp.nCols, inp.xllcorner, inp.yllcorner, inp.cellsize, inp.nodata_value);
+   }
+
+   // Runs a single output slope kernel over inp
+   template <class T, class Kernel>
+   static BasicRaster<double> _ComputeSlope(const BasicRasterView<const T> &inp)
+   {
+      BasicRaster<double> slope = _DoubleLike(inp);
+      FocalApply(inp, Kernel{inp.cellsize}, slope.view());
+      return slope;
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlope(SlopeMethod method) const
+   {
+      return EnumToSlope<T>.at(method)(*this);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlope(const BasicRasterView<const T> &inp, SlopeMethod method)
+   {
+      return EnumToSlope<T>.at(method)(inp);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlopeZevenbergenThorne(const BasicRasterView<const T> &inp)
+   {
+      return _ComputeSlope<T, _ZevenbergenThorneSlope>(inp);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlopeHorn(const BasicRasterView<const T> &inp)
+   {
+      return _ComputeSlope<T, _HornSlope>(inp);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlopeEvansYoung(const BasicRasterView<const T> &inp)
+   {
+      return _ComputeSlope<T, _EvansYoungSlope>(inp);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeSlopeMaxDownhill(const BasicRasterView<const T> &inp)
+   {
+      return _ComputeSlope<T, _MaxDownhillSlope>(inp);
+   }
+
+   template <class T>
+   typename BasicRaster<T>::TerrainDerivatives
+      BasicRaster<T>::ComputeTerrainDerivatives(const BasicRasterView<const T> &inp, unsigned derivatives)
+   {
+      TerrainDerivatives                     result;
+      std::array<BasicRaster<double> *, 5>   rasters{
+         &result.slope, &result.aspect, &result.profileCurvature, &result.planCurvature, &result.totalCurvature};
+      std::array<BasicRasterView<double>, 5> outs;
+
+      // Derivatives that are not requested keep an empty view, FocalApply drops them
+      for (size_t k = 0; k < rasters.size(); k++)
       {
-         for (int c = 0; c < NC; c++)
+         if (derivatives & (1u << k))
          {
-            if (inp(r, c) == ND)
-            {
-               slope(r, c) = ND;
-               continue;
-            }
-            slope(r, c) = getSlope(r, c);
+            *rasters[k] = _DoubleLike(inp);
+            outs[k]     = rasters[k]->view();
          }
       }
 
-      return slope;
+      if (derivatives & Aspect)
+         FocalApply(inp, _ZevenbergenThorneDerivatives<true>{inp.cellsize}, outs);
+      else
+         FocalApply(inp, _ZevenbergenThorneDerivatives<false>{inp.cellsize}, outs);
+      return result;
+   }
+
+   template <class T>
+   typename BasicRaster<T>::TerrainDerivatives BasicRaster<T>::ComputeTerrainDerivatives(unsigned derivatives) const
+   {
+      return ComputeTerrainDerivatives(*this, derivatives);
    }
-} // namespace KiLib
\ No newline at end of file
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlope(SlopeMethod method) const;                                \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlope(const BasicRasterView<const T> &inp, SlopeMethod method); \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlopeZevenbergenThorne(const BasicRasterView<const T> &inp);    \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlopeHorn(const BasicRasterView<const T> &inp);                 \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlopeEvansYoung(const BasicRasterView<const T> &inp);           \
+   template BasicRaster<double> BasicRaster<T>::ComputeSlopeMaxDownhill(const BasicRasterView<const T> &inp);          \
+   template BasicRaster<T>::TerrainDerivatives BasicRaster<T>::ComputeTerrainDerivatives(                              \
+      const BasicRasterView<const T> &inp, unsigned derivatives);                                                      \
+   template BasicRaster<T>::TerrainDerivatives BasicRaster<T>::ComputeTerrainDerivatives(unsigned derivatives) const;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
@@ -0,0 +1,1028 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _USE_MATH_DEFINES
+#include <KiLib/Raster/Flow.hpp>
+#include <KiLib/Raster/Focal.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Nodata value of accumulation rasters
+static constexpr double _AccumulationNoData = -9999;
+
+// Marks a cell without receiver
+static constexpr size_t _NoCell = std::numeric_limits<size_t>::max();
+
+// Raster with the metadata of view, cells of type U and the given nodata value. Cells are meant to be overwritten.
+template <class U, class T>
+static KiLib::BasicRaster<U> _RasterLike(const KiLib::BasicRasterView<T> &view, double nodata)
+{
+   return KiLib::BasicRaster<U>::fromMetadata(
+      view.nRows, view.nCols, view.xllcorner, view.yllcorner, view.cellsize, nodata);
+}
+
+// Steepest drop to the 8 neighbours. Missing neighbours hold the centre value and have no drop, so they are never
+// picked.
+struct _D8Direction
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   double operator()(const W &z) const
+   {
+      const double centre = z(0, 0);
+      const double diag   = cellsize * std::sqrt(2.0);
+      double       best   = 0;
+      double       code   = KiLib::D8None;
+
+      // Selects rather than branches so the loop of FocalApply vectorizes. The first of equal drops wins.
+      auto consider = [&](int dr, int dc, double distance, double direction)
+      {
+         const double drop = (centre - z(dr, dc)) / distance;
+         code              = drop > best ? direction : code;
+         best              = drop > best ? drop : best;
+      };
+      consider(0, 1, cellsize, KiLib::D8East);
+      consider(-1, 1, diag, KiLib::D8SouthEast);
+      consider(-1, 0, cellsize, KiLib::D8South);
+      consider(-1, -1, diag, KiLib::D8SouthWest);
+      consider(0, -1, cellsize, KiLib::D8West);
+      consider(1, -1, diag, KiLib::D8NorthWest);
+      consider(1, 0, cellsize, KiLib::D8North);
+      consider(1, 1, diag, KiLib::D8NorthEast);
+      return code;
+   }
+};
+
+// Tarboton, D.G. (1997), A new method for the determination of flow directions and upslope areas in grid digital
+// elevation models. Water Resources Research, 33(2): 309-319. https://doi.org/10.1029/96WR03137
+// Missing neighbours hold the centre value. A facet with a missing diagonal cell then drains along its edge, and one
+// with a missing adjacent cell drains to the diagonal or not at all, so flow never reaches a missing cell.
+struct _DInfDirection
+{
+   static constexpr int radius = 1;
+   double               cellsize;
+
+   template <class W>
+   double operator()(const W &z) const
+   {
+      // Adjacent cell, diagonal cell and direction multipliers (ac, af) of the 8 facets, Table 1
+      struct Facet
+      {
+         int dr1, dc1, dr2, dc2, ac, af;
+      };
+      static constexpr Facet facets[8] = {
+         {0, 1, 1, 1, 0, 1},   {1, 0, 1, 1, 1, -1},   {1, 0, 1, -1, 1, 1},   {0, -1, 1, -1, 2, -1},
+         {0, -1, -1, -1, 2, 1}, {-1, 0, -1, -1, 3, -1}, {-1, 0, -1, 1, 3, 1}, {0, 1, -1, 1, 4, -1},
+      };
+
+      const double e0    = z(0, 0);
+      double       best  = 0;
+      double       angle = -1;
+      for (const Facet &f : facets)
+      {
+         const double e1 = z(f.dr1, f.dc1);
+         const double e2 = z(f.dr2, f.dc2);
+         const double s1 = (e0 - e1) / cellsize;
+         const double s2 = (e1 - e2) / cellsize;
+         double       r  = std::atan2(s2, s1);
+         double       s  = std::sqrt(s1 * s1 + s2 * s2);
+         if (r < 0)
+         {
+            r = 0;
+            s = s1;
+         }
+         else if (r > M_PI / 4)
+         {
+            r = M_PI / 4;
+            s = (e0 - e2) / (cellsize * std::sqrt(2.0));
+         }
+
+         if (s > best)
+         {
+            best  = s;
+            angle = f.af * r + f.ac * M_PI / 2;
+         }
+      }
+      return angle >= 2 * M_PI ? angle - 2 * M_PI : angle;
+   }
+};
+
+// Offset of the neighbour a D8 direction points to, false for cells without one
+static bool _D8Offset(uint8_t direction, int &dr, int &dc)
+{
+   switch (direction)
+   {
+   case KiLib::D8East:
+      dr = 0, dc = 1;
+      return true;
+   case KiLib::D8SouthEast:
+      dr = -1, dc = 1;
+      return true;
+   case KiLib::D8South:
+      dr = -1, dc = 0;
+      return true;
+   case KiLib::D8SouthWest:
+      dr = -1, dc = -1;
+      return true;
+   case KiLib::D8West:
+      dr = 0, dc = -1;
+      return true;
+   case KiLib::D8NorthWest:
+      dr = 1, dc = -1;
+      return true;
+   case KiLib::D8North:
+      dr = 1, dc = 0;
+      return true;
+   case KiLib::D8NorthEast:
+      dr = 1, dc = 1;
+      return true;
+   default:
+      return false;
+   }
+}
+
+// Rectangle of cells swept at once by ComputeFlowAccumulationD8 or filled at once by FillDepressions
+struct _FlowTile
+{
+   long r0, c0, nRows, nCols;
+
+   // Tile t of the tiles of side x side cells covering a raster of NR x NC cells, numbered row by row
+   static _FlowTile at(long t, long side, long NR, long NC)
+   {
+      const long nTC = (NC + side - 1) / side;
+      const long r0  = (t / nTC) * side;
+      const long c0  = (t % nTC) * side;
+      return _FlowTile{r0, c0, std::min(side, NR - r0), std::min(side, NC - c0)};
+   }
+
+   bool contains(long r, long c) const
+   {
+      return r >= this->r0 && r < this->r0 + this->nRows && c >= this->c0 && c < this->c0 + this->nCols;
+   }
+
+   size_t local(long r, long c) const
+   {
+      return static_cast<size_t>((r - this->r0) * this->nCols + (c - this->c0));
+   }
+
+   bool onBorder(long r, long c) const
+   {
+      return r == this->r0 || r == this->r0 + this->nRows - 1 || c == this->c0 || c == this->c0 + this->nCols - 1;
+   }
+
+   // Calls f(r, c) for every cell on the border of the tile
+   template <class F>
+   void forEachBorderCell(F f) const
+   {
+      for (long c = this->c0; c < this->c0 + this->nCols; c++)
+      {
+         f(this->r0, c);
+         if (this->nRows > 1)
+            f(this->r0 + this->nRows - 1, c);
+      }
+      for (long r = this->r0 + 1; r < this->r0 + this->nRows - 1; r++)
+      {
+         f(r, this->c0);
+         if (this->nCols > 1)
+            f(r, this->c0 + this->nCols - 1);
+      }
+   }
+
+   // Position of border cell (r, c) in a list of the cells of the bottom row, top row, left and right columns
+   size_t borderSlot(long r, long c) const
+   {
+      const long lr = r - this->r0;
+      const long lc = c - this->c0;
+      if (lr == 0)
+         return lc;
+      if (lr == this->nRows - 1)
+         return this->nCols + lc;
+      if (lc == 0)
+         return 2 * this->nCols + lr;
+      return 2 * this->nCols + this->nRows + lr;
+   }
+
+   size_t nBorderSlots() const
+   {
+      return 2 * (this->nRows + this->nCols);
+   }
+};
+
+// Offsets of the 8 neighbours of a cell
+static constexpr int _NeighbourRow[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static constexpr int _NeighbourCol[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+
+// Whether valid cell (r, c) of dem drains out of it: it lies on the edge of the raster or next to a nodata cell
+template <class T>
+static bool _IsOutlet(const KiLib::BasicRasterView<T> &dem, long r, long c)
+{
+   if (r == 0 || c == 0 || r == static_cast<long>(dem.nRows) - 1 || c == static_cast<long>(dem.nCols) - 1)
+      return true;
+   for (int k = 0; k < 8; k++)
+      if (dem(r + _NeighbourRow[k], c + _NeighbourCol[k]) == dem.nodata_value)
+         return true;
+   return false;
+}
+
+// Smallest value above v when filling with epsilon, v otherwise. Integer rasters are filled flat.
+template <class T>
+static T _FillStep(T v, bool epsilon)
+{
+   if constexpr (std::is_floating_point_v<T>)
+      return epsilon ? std::nextafter(v, std::numeric_limits<T>::infinity()) : v;
+   else
+      return v;
+}
+
+// Cell waiting in the priority queue of the Priority-Flood, lowest first
+template <class T>
+struct _FloodCell
+{
+   T      level;
+   size_t cell;
+
+   bool operator>(const _FloodCell &other) const
+   {
+      return this->level > other.level || (this->level == other.level && this->cell > other.cell);
+   }
+};
+
+template <class T>
+using _FloodQueue = std::priority_queue<_FloodCell<T>, std::vector<_FloodCell<T>>, std::greater<_FloodCell<T>>>;
+
+// Priority-Flood+Epsilon of Barnes et al. (2014), Algorithm 3, over the cells of tile. open holds the seeds, which
+// are flagged in closed. Every other valid cell of the tile is raised to at least the step above the cell it is
+// reached from. onPop(l) is called for every cell taken from the queues, then onNeighbour(l, n) for each of its valid
+// neighbours in the tile.
+template <class T, class OnPop, class OnNeighbour>
+static void _PriorityFlood(
+   const KiLib::BasicRasterView<T> &dem, const _FlowTile &tile, _FloodQueue<T> &open, std::vector<uint8_t> &closed,
+   bool epsilon, OnPop onPop, OnNeighbour onNeighbour)
+{
+   // Raised cells, which need no sorting as they are at most one step above the cell being processed
+   std::queue<size_t> pit;
+
+   auto level = [&](size_t l) { return dem(tile.r0 + l / tile.nCols, tile.c0 + l % tile.nCols); };
+
+   while (!open.empty() || !pit.empty())
+   {
+      // Unraised cells at the level of the pit go first, the pit may drain through them
+      size_t l;
+      if (!pit.empty() && (open.empty() || open.top().level != level(pit.front())))
+      {
+         l = pit.front();
+         pit.pop();
+      }
+      else
+      {
+         l = open.top().cell;
+         open.pop();
+      }
+      onPop(l);
+
+      const long r    = tile.r0 + l / tile.nCols;
+      const long c    = tile.c0 + l % tile.nCols;
+      const T    step = _FillStep(dem(r, c), epsilon);
+      for (int k = 0; k < 8; k++)
+      {
+         const long rr = r + _NeighbourRow[k];
+         const long cc = c + _NeighbourCol[k];
+         if (!tile.contains(rr, cc) || dem(rr, cc) == dem.nodata_value)
+            continue;
+
+         const size_t n = tile.local(rr, cc);
+         if (!closed[n])
+         {
+            closed[n] = 1;
+            if (dem(rr, cc) <= step)
+            {
+               dem(rr, cc) = step;
+               pit.push(n);
+            }
+            else
+            {
+               open.push({dem(rr, cc), n});
+            }
+         }
+         onNeighbour(l, n);
+      }
+   }
+}
+
+namespace KiLib
+{
+   template <class T>
+   void FillDepressions(const BasicRasterView<T> &dem, bool epsilon, size_t tileSize)
+   {
+      const long NR = static_cast<long>(dem.nRows);
+      const long NC = static_cast<long>(dem.nCols);
+      if (NR == 0 || NC == 0)
+         return;
+
+      const long side   = tileSize > 0 ? static_cast<long>(tileSize) : std::max(NR, NC);
+      const long nTC    = (NC + side - 1) / side;
+      const long nTiles = ((NR + side - 1) / side) * nTC;
+
+      auto valid = [&](long r, long c) { return dem(r, c) != dem.nodata_value; };
+      auto none  = [](auto...) {};
+
+      if (nTiles == 1)
+      {
+         const _FlowTile      tile = _FlowTile::at(0, side, NR, NC);
+         std::vector<uint8_t> closed(NR * NC, 0);
+         _FloodQueue<T>       open;
+         for (long r = 0; r < NR; r++)
+         {
+            for (long c = 0; c < NC; c++)
+            {
+               if (valid(r, c) && _IsOutlet(dem, r, c))
+               {
+                  closed[tile.local(r, c)] = 1;
+                  open.push({dem(r, c), tile.local(r, c)});
+               }
+            }
+         }
+         _PriorityFlood(dem, tile, open, closed, epsilon, none, none);
+         return;
+      }
+
+      // Fills every tile as if its border drained, labelling the watershed of each border cell. Label 1 is shared by
+      // the cells draining out of the raster, 0 marks cells not labelled yet.
+      static constexpr uint32_t outside = 1;
+
+      // Lowest level at which water crosses between two watersheds
+      struct Spill
+      {
+         size_t a, b;
+         double level;
+      };
+      std::vector<uint32_t>              nLabels(nTiles);
+      std::vector<std::vector<uint32_t>> borderLabels(nTiles);
+      std::vector<std::vector<Spill>>    spills(nTiles);
+
+#pragma omp parallel for schedule(dynamic)
+      for (long t = 0; t < nTiles; t++)
+      {
+         const _FlowTile       tile = _FlowTile::at(t, side, NR, NC);
+         std::vector<uint32_t> label(tile.nRows * tile.nCols, 0);
+         std::vector<uint8_t>  closed(label.size(), 0);
+         _FloodQueue<T>        open;
+         uint32_t              next = outside + 1;
+
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+         {
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+            {
+               const bool outlet = valid(r, c) && _IsOutlet(dem, r, c);
+               if (valid(r, c) && (outlet || tile.onBorder(r, c)))
+               {
+                  const size_t l = tile.local(r, c);
+                  closed[l]      = 1;
+                  label[l]       = outlet ? outside : 0;
+                  open.push({dem(r, c), l});
+               }
+            }
+         }
+
+         auto level = [&](size_t l) { return dem(tile.r0 + l / tile.nCols, tile.c0 + l % tile.nCols); };
+         _PriorityFlood(
+            dem, tile, open, closed, false,
+            [&](size_t l)
+            {
+               if (label[l] == 0)
+                  label[l] = next++;
+            },
+            [&](size_t l, size_t n)
+            {
+               if (label[n] == 0)
+                  label[n] = label[l];
+               else if (label[n] != label[l])
+                  spills[t].push_back({std::min(label[l], label[n]), std::max(label[l], label[n]),
+                                       static_cast<double>(std::max(level(l), level(n)))});
+            });
+
+         // Keeps the lowest spill between every pair of watersheds
+         auto &tileSpills = spills[t];
+         std::sort(
+            tileSpills.begin(), tileSpills.end(), [](const Spill &x, const Spill &y)
+            { return x.a != y.a ? x.a < y.a : x.b != y.b ? x.b < y.b : x.level < y.level; });
+         tileSpills.erase(
+            std::unique(
+               tileSpills.begin(), tileSpills.end(), [](const Spill &x, const Spill &y)
+               { return x.a == y.a && x.b == y.b; }),
+            tileSpills.end());
+
+         borderLabels[t].resize(tile.nBorderSlots());
+         tile.forEachBorderCell([&](long r, long c)
+                                { borderLabels[t][tile.borderSlot(r, c)] = label[tile.local(r, c)]; });
+         nLabels[t] = next;
+      }
+
+      // Numbers the watersheds of all tiles in turn after the outside
+      std::vector<size_t> base(nTiles + 1, outside + 1);
+      for (long t = 0; t < nTiles; t++)
+         base[t + 1] = base[t] + nLabels[t] - (outside + 1);
+      auto global = [&](long t, uint32_t l) { return l == outside ? size_t(outside) : base[t] + l - (outside + 1); };
+
+      auto borderLabel = [&](long r, long c)
+      {
+         const long      t    = (r / side) * nTC + c / side;
+         const _FlowTile tile = _FlowTile::at(t, side, NR, NC);
+         return global(t, borderLabels[t][tile.borderSlot(r, c)]);
+      };
+
+      // Graph of the watersheds, joined by spills within tiles and between neighbouring border cells of two tiles
+      std::vector<Spill> edges;
+      for (long t = 0; t < nTiles; t++)
+      {
+         for (const Spill &s : spills[t])
+            edges.push_back({global(t, s.a), global(t, s.b), s.level});
+         spills[t] = std::vector<Spill>();
+
+         const _FlowTile tile = _FlowTile::at(t, side, NR, NC);
+         tile.forEachBorderCell(
+            [&](long r, long c)
+            {
+               if (!valid(r, c))
+                  return;
+               for (int k = 0; k < 8; k++)
+               {
+                  const long rr = r + _NeighbourRow[k];
+                  const long cc = c + _NeighbourCol[k];
+                  if (rr < 0 || rr >= NR || cc < 0 || cc >= NC || tile.contains(rr, cc) || !valid(rr, cc) ||
+                      rr * NC + cc < r * NC + c)
+                     continue;
+                  edges.push_back({borderLabel(r, c), borderLabel(rr, cc),
+                                   static_cast<double>(std::max(dem(r, c), dem(rr, cc)))});
+               }
+            });
+      }
+
+      std::vector<size_t> offsets(base[nTiles] + 1, 0);
+      for (const Spill &e : edges)
+      {
+         offsets[e.a + 1]++;
+         offsets[e.b + 1]++;
+      }
+      for (size_t i = 1; i < offsets.size(); i++)
+         offsets[i] += offsets[i - 1];
+      std::vector<std::pair<size_t, double>> adjacent(offsets.back());
+      {
+         std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+         for (const Spill &e : edges)
+         {
+            adjacent[fill[e.a]++] = {e.b, e.level};
+            adjacent[fill[e.b]++] = {e.a, e.level};
+         }
+      }
+      edges = std::vector<Spill>();
+
+      // Level every watershed fills up to: the lowest over all paths out of the raster of the highest spill on the
+      // path, found like shortest paths
+      const double        inf = std::numeric_limits<double>::infinity();
+      std::vector<double> fillLevel(base[nTiles], inf);
+      std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, std::greater<>> queue;
+      fillLevel[outside] = -inf;
+      queue.push({-inf, outside});
+      while (!queue.empty())
+      {
+         const auto [level, w] = queue.top();
+         queue.pop();
+         if (level > fillLevel[w])
+            continue;
+         for (size_t i = offsets[w]; i < offsets[w + 1]; i++)
+         {
+            const auto [v, spill] = adjacent[i];
+            const double through  = std::max(level, spill);
+            if (through < fillLevel[v])
+            {
+               fillLevel[v] = through;
+               queue.push({through, v});
+            }
+         }
+      }
+
+      // Fills every tile again from its border raised to the fill levels
+#pragma omp parallel for schedule(dynamic)
+      for (long t = 0; t < nTiles; t++)
+      {
+         const _FlowTile      tile = _FlowTile::at(t, side, NR, NC);
+         std::vector<uint8_t> closed(tile.nRows * tile.nCols, 0);
+         _FloodQueue<T>       open;
+
+         tile.forEachBorderCell(
+            [&](long r, long c)
+            {
+               const double level = fillLevel[global(t, borderLabels[t][tile.borderSlot(r, c)])];
+               if (valid(r, c) && level > dem(r, c) && level < inf)
+                  dem(r, c) = static_cast<T>(level);
+            });
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+         {
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+            {
+               if (valid(r, c) && (tile.onBorder(r, c) || _IsOutlet(dem, r, c)))
+               {
+                  closed[tile.local(r, c)] = 1;
+                  open.push({dem(r, c), tile.local(r, c)});
+               }
+            }
+         }
+         _PriorityFlood(dem, tile, open, closed, false, none, none);
+      }
+
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         if (!epsilon)
+            return;
+
+         auto drains = [&](long r, long c)
+         {
+            if (_IsOutlet(dem, r, c))
+               return true;
+            for (int k = 0; k < 8; k++)
+               if (dem(r + _NeighbourRow[k], c + _NeighbourCol[k]) < dem(r, c))
+                  return true;
+            return false;
+         };
+
+         // Flats get a gradient away from the cells draining out of them, rising by one step per cell. mark flags
+         // the cells of the flat being resolved (1) and the cells already given their level (2).
+         std::vector<uint8_t> mark(NR * NC, 0);
+         auto resolveFlat = [&](long r0, long c0, const _FlowTile &region)
+         {
+            const T             level = dem(r0, c0);
+            std::vector<size_t> flat(1, r0 * NC + c0), front, next;
+            mark[r0 * NC + c0] = 1;
+            for (size_t i = 0; i < flat.size(); i++)
+            {
+               for (int k = 0; k < 8; k++)
+               {
+                  const long rr = flat[i] / NC + _NeighbourRow[k];
+                  const long cc = flat[i] % NC + _NeighbourCol[k];
+                  if (region.contains(rr, cc) && dem(rr, cc) == level && mark[rr * NC + cc] == 0)
+                  {
+                     mark[rr * NC + cc] = 1;
+                     flat.push_back(rr * NC + cc);
+                  }
+               }
+            }
+
+            for (size_t i : flat)
+            {
+               if (drains(i / NC, i % NC))
+               {
+                  mark[i] = 2;
+                  front.push_back(i);
+               }
+            }
+            for (T value = _FillStep(level, true); !front.empty(); value = _FillStep(value, true))
+            {
+               next.clear();
+               for (size_t i : front)
+               {
+                  for (int k = 0; k < 8; k++)
+                  {
+                     const long rr = i / NC + _NeighbourRow[k];
+                     const long cc = i % NC + _NeighbourCol[k];
+                     if (region.contains(rr, cc) && mark[rr * NC + cc] == 1)
+                     {
+                        mark[rr * NC + cc] = 2;
+                        dem(rr, cc)        = value;
+                        next.push_back(rr * NC + cc);
+                     }
+                  }
+               }
+               front.swap(next);
+            }
+         };
+
+         // Flats reaching a tile border without draining through it get their gradient from the whole raster, after
+         // which every tile border drains
+         const _FlowTile raster{0, 0, NR, NC};
+         for (long t = 0; t < nTiles; t++)
+         {
+            _FlowTile::at(t, side, NR, NC).forEachBorderCell(
+               [&](long r, long c)
+               {
+                  if (valid(r, c) && mark[r * NC + c] == 0 && !drains(r, c))
+                     resolveFlat(r, c, raster);
+               });
+         }
+
+         // The other flats lie within a tile
+#pragma omp parallel for schedule(dynamic)
+         for (long t = 0; t < nTiles; t++)
+         {
+            const _FlowTile tile = _FlowTile::at(t, side, NR, NC);
+            for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+               for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+                  if (valid(r, c) && mark[r * NC + c] == 0 && !drains(r, c))
+                     resolveFlat(r, c, tile);
+         }
+         mark = std::vector<uint8_t>();
+
+         // A gradient can reach a neighbour of the flat lying only a few steps above it. The cells left without a lower
+         // neighbour are raised just above their lowest one, which may in turn do the same to their neighbours.
+         std::vector<std::vector<size_t>> flattened(nTiles);
+#pragma omp parallel for schedule(dynamic)
+         for (long t = 0; t < nTiles; t++)
+         {
+            const _FlowTile tile = _FlowTile::at(t, side, NR, NC);
+            for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+               for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+                  if (valid(r, c) && !drains(r, c))
+                     flattened[t].push_back(r * NC + c);
+         }
+
+         _FloodQueue<T> stuck;
+         for (const auto &cells : flattened)
+            for (size_t i : cells)
+               stuck.push({dem(i / NC, i % NC), i});
+         while (!stuck.empty())
+         {
+            const long r = stuck.top().cell / NC;
+            const long c = stuck.top().cell % NC;
+            stuck.pop();
+            if (drains(r, c))
+               continue;
+
+            T lowest = std::numeric_limits<T>::max();
+            for (int k = 0; k < 8; k++)
+               lowest = std::min(lowest, dem(r + _NeighbourRow[k], c + _NeighbourCol[k]));
+            dem(r, c) = _FillStep(lowest, true);
+
+            for (int k = 0; k < 8; k++)
+            {
+               const long rr = r + _NeighbourRow[k];
+               const long cc = c + _NeighbourCol[k];
+               if (valid(rr, cc) && !drains(rr, cc))
+                  stuck.push({dem(rr, cc), static_cast<size_t>(rr * NC + cc)});
+            }
+         }
+      }
+   }
+
+   template <class T>
+   BasicRaster<uint8_t> ComputeFlowDirectionD8(const BasicRasterView<const T> &dem)
+   {
+      BasicRaster<uint8_t> directions = _RasterLike<uint8_t>(dem, D8NoData);
+      FocalApply(dem, _D8Direction{dem.cellsize}, directions.view());
+      return directions;
+   }
+
+   template <class T>
+   Raster ComputeFlowDirectionDInf(const BasicRasterView<const T> &dem)
+   {
+      Raster directions = _RasterLike<double>(dem, dem.nodata_value);
+      FocalApply(dem, _DInfDirection{dem.cellsize}, directions.view());
+      return directions;
+   }
+
+   Raster ComputeFlowAccumulationD8(const BasicRasterView<const uint8_t> &directions, size_t tileSize)
+   {
+      const long   NR   = static_cast<long>(directions.nRows);
+      const long   NC   = static_cast<long>(directions.nCols);
+      const double area = directions.cellsize * directions.cellsize;
+      const long   side = tileSize > 0 ? static_cast<long>(tileSize) : std::max(NR, NC);
+      const long   nTR  = (NR + side - 1) / side;
+      const long   nTC  = (NC + side - 1) / side;
+
+      Raster acc = _RasterLike<double>(directions, _AccumulationNoData);
+
+      auto valid = [&](long r, long c) { return directions(r, c) != directions.nodata_value; };
+
+      // Receiving cell of (r, c), false if it drains nowhere
+      auto receiver = [&](long r, long c, long &rr, long &cc)
+      {
+         int dr, dc;
+         if (!_D8Offset(directions(r, c), dr, dc))
+            return false;
+         rr = r + dr;
+         cc = c + dc;
+         return rr >= 0 && rr < NR && cc >= 0 && cc < NC && valid(rr, cc);
+      };
+
+      auto tileAt = [&](long t) { return _FlowTile::at(t, side, NR, NC); };
+
+      // Sweeps tile in topological order, adding the value of every cell to its receiver within the tile. val holds
+      // one value per cell of the tile. order receives the cells in the order they were swept when not null.
+      auto sweep = [&](const _FlowTile &tile, std::vector<double> &val, std::vector<uint32_t> *order)
+      {
+         std::vector<uint8_t>  donors(val.size(), 0);
+         std::vector<uint32_t> ready;
+         long                  rr, cc;
+
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+         {
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+            {
+               if (valid(r, c) && receiver(r, c, rr, cc) && tile.contains(rr, cc))
+                  donors[tile.local(rr, cc)]++;
+            }
+         }
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+         {
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+            {
+               if (valid(r, c) && donors[tile.local(r, c)] == 0)
+                  ready.push_back(static_cast<uint32_t>(tile.local(r, c)));
+            }
+         }
+
+         while (!ready.empty())
+         {
+            const uint32_t l = ready.back();
+            ready.pop_back();
+            if (order)
+               order->push_back(l);
+
+            const long r = tile.r0 + l / tile.nCols;
+            const long c = tile.c0 + l % tile.nCols;
+            if (receiver(r, c, rr, cc) && tile.contains(rr, cc))
+            {
+               const size_t lr = tile.local(rr, cc);
+               val[lr] += val[l];
+               if (--donors[lr] == 0)
+                  ready.push_back(static_cast<uint32_t>(lr));
+            }
+         }
+      };
+
+      // Flow leaving a tile into a cell of another one
+      struct Exit
+      {
+         size_t cell;
+         double flow;
+      };
+      // Tile border cell and the cell of another tile its flow path leaves to (_NoCell if it stays in the tile)
+      struct Border
+      {
+         size_t cell;
+         size_t next;
+      };
+      std::vector<std::vector<Exit>>   exits(nTR * nTC);
+      std::vector<std::vector<Border>> borders(nTR * nTC);
+
+      // Accumulates every tile on its own
+#pragma omp parallel for schedule(dynamic)
+      for (long t = 0; t < nTR * nTC; t++)
+      {
+         const _FlowTile       tile = tileAt(t);
+         std::vector<double>   val(tile.nRows * tile.nCols);
+         std::vector<uint32_t> order;
+         long                  rr, cc;
+
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+               val[tile.local(r, c)] = valid(r, c) ? area : 0;
+
+         sweep(tile, val, &order);
+
+         // Receivers come after their donors in order, so walking it backwards gives where each flow path leaves the
+         // tile
+         std::vector<size_t> next(val.size(), _NoCell);
+         for (auto it = order.rbegin(); it != order.rend(); it++)
+         {
+            const long r = tile.r0 + *it / tile.nCols;
+            const long c = tile.c0 + *it % tile.nCols;
+            if (!receiver(r, c, rr, cc))
+               continue;
+            if (tile.contains(rr, cc))
+            {
+               next[*it] = next[tile.local(rr, cc)];
+            }
+            else
+            {
+               next[*it] = rr * NC + cc;
+               exits[t].push_back({next[*it], val[*it]});
+            }
+         }
+
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+         {
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+            {
+               acc(r, c) = valid(r, c) ? val[tile.local(r, c)] : _AccumulationNoData;
+
+               // Only border cells can receive flow from other tiles
+               if (tile.onBorder(r, c) && nTR * nTC > 1)
+                  borders[t].push_back({static_cast<size_t>(r * NC + c), next[tile.local(r, c)]});
+            }
+         }
+      }
+
+      if (nTR * nTC == 1)
+         return acc;
+
+      // Merges the flows crossing tile borders. Flow entering a tile follows the path of the cell it enters through
+      // and leaves at the end of it, so the border cells form a forest that is swept like the cells of a tile.
+      std::vector<Border> nodes;
+      for (const auto &b : borders)
+         nodes.insert(nodes.end(), b.begin(), b.end());
+      std::sort(nodes.begin(), nodes.end(), [](const Border &a, const Border &b) { return a.cell < b.cell; });
+
+      auto find = [&](size_t cell)
+      {
+         auto it = std::lower_bound(
+            nodes.begin(), nodes.end(), cell, [](const Border &b, size_t cell) { return b.cell < cell; });
+         return static_cast<size_t>(it - nodes.begin());
+      };
+
+      std::vector<double>   inflow(nodes.size(), 0);
+      std::vector<uint32_t> donors(nodes.size(), 0);
+      for (const auto &tileExits : exits)
+         for (const Exit &e : tileExits)
+            inflow[find(e.cell)] += e.flow;
+      for (const Border &b : nodes)
+         if (b.next != _NoCell)
+            donors[find(b.next)]++;
+
+      std::vector<size_t> ready;
+      for (size_t i = 0; i < nodes.size(); i++)
+         if (donors[i] == 0)
+            ready.push_back(i);
+      while (!ready.empty())
+      {
+         const size_t i = ready.back();
+         ready.pop_back();
+         if (nodes[i].next == _NoCell)
+            continue;
+         const size_t j = find(nodes[i].next);
+         inflow[j] += inflow[i];
+         if (--donors[j] == 0)
+            ready.push_back(j);
+      }
+
+      // Carries the flow entering every tile down its paths
+#pragma omp parallel for schedule(dynamic)
+      for (long t = 0; t < nTR * nTC; t++)
+      {
+         const _FlowTile     tile = tileAt(t);
+         std::vector<double> val(tile.nRows * tile.nCols, 0);
+         bool                any = false;
+
+         for (const Border &b : borders[t])
+         {
+            const double in = inflow[find(b.cell)];
+            val[tile.local(b.cell / NC, b.cell % NC)] = in;
+            any |= in != 0;
+         }
+         if (!any)
+            continue;
+
+         sweep(tile, val, nullptr);
+         for (long r = tile.r0; r < tile.r0 + tile.nRows; r++)
+            for (long c = tile.c0; c < tile.c0 + tile.nCols; c++)
+               if (valid(r, c))
+                  acc(r, c) += val[tile.local(r, c)];
+      }
+
+      return acc;
+   }
+
+   Raster ComputeFlowAccumulationDInf(const RasterView &directions)
+   {
+      const long   NR   = static_cast<long>(directions.nRows);
+      const long   NC   = static_cast<long>(directions.nCols);
+      const double area = directions.cellsize * directions.cellsize;
+
+      Raster acc = _RasterLike<double>(directions, _AccumulationNoData);
+
+      auto valid = [&](long r, long c) { return directions(r, c) != directions.nodata_value; };
+
+      // Neighbours bounding the direction of (r, c) and the share of its flow each receives. Returns the number of
+      // receivers.
+      auto receivers = [&](long r, long c, size_t cells[2], double shares[2])
+      {
+         static constexpr int dr[8] = {0, 1, 1, 1, 0, -1, -1, -1}; // Counterclockwise from east
+         static constexpr int dc[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+
+         const double angle = directions(r, c);
+         if (angle < 0)
+            return 0;
+
+         const double sector = angle / (M_PI / 4);
+         const int    k      = std::min(static_cast<int>(sector), 7);
+         const double split  = sector - k;
+
+         int n = 0;
+         for (int i = 0; i < 2; i++)
+         {
+            const int    j     = (k + i) % 8;
+            const double share = i == 0 ? 1 - split : split;
+            const long   rr    = r + dr[j];
+            const long   cc    = c + dc[j];
+            if (share > 0 && rr >= 0 && rr < NR && cc >= 0 && cc < NC && valid(rr, cc))
+            {
+               cells[n]  = rr * NC + cc;
+               shares[n] = share;
+               n++;
+            }
+         }
+         return n;
+      };
+
+      std::vector<uint8_t> donors(NR * NC, 0);
+      std::vector<size_t>  ready;
+      size_t               cells[2];
+      double               shares[2];
+
+      for (long r = 0; r < NR; r++)
+      {
+         for (long c = 0; c < NC; c++)
+         {
+            acc(r, c) = valid(r, c) ? area : _AccumulationNoData;
+            if (!valid(r, c))
+               continue;
+            const int n = receivers(r, c, cells, shares);
+            for (int i = 0; i < n; i++)
+               donors[cells[i]]++;
+         }
+      }
+      for (long i = 0; i < NR * NC; i++)
+         if (donors[i] == 0 && valid(i / NC, i % NC))
+            ready.push_back(i);
+
+      while (!ready.empty())
+      {
+         const size_t i = ready.back();
+         ready.pop_back();
+
+         const int n = receivers(i / NC, i % NC, cells, shares);
+         for (int k = 0; k < n; k++)
+         {
+            acc(cells[k]) += acc(i) * shares[k];
+            if (--donors[cells[k]] == 0)
+               ready.push_back(cells[k]);
+         }
+      }
+
+      return acc;
+   }
+
+   Raster ComputeTopographicWetnessIndex(
+      const RasterView &dem, const RasterView &accumulation, Raster::SlopeMethod method, double minSlope)
+   {
+      if (accumulation.nRows != dem.nRows || accumulation.nCols != dem.nCols)
+         throw std::invalid_argument("Accumulation must have the size of the DEM");
+
+      // The slope raster receives the index, it has nodata where dem has
+      Raster       twi      = Raster::ComputeSlope(dem, method);
+      const double nodata   = twi.nodata_value;
+      const double accNd    = accumulation.nodata_value;
+      const double width    = dem.cellsize;
+      const long   nRows    = static_cast<long>(dem.nRows);
+      const size_t nCols    = dem.nCols;
+      double      *twiCells = twi.data.data();
+
+#pragma omp parallel for
+      for (long r = 0; r < nRows; r++)
+      {
+         const double *acc = &accumulation(r, 0);
+         double       *out = twiCells + r * nCols;
+#pragma omp simd
+         for (size_t c = 0; c < nCols; c++)
+         {
+            const double slope   = out[c] > minSlope ? out[c] : minSlope;
+            const double index   = std::log(acc[c] / width / slope);
+            const bool   missing = out[c] == nodata || acc[c] == accNd;
+            out[c]               = missing ? nodata : index;
+         }
+      }
+      return twi;
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template void FillDepressions(const BasicRasterView<T> &dem, bool epsilon, size_t tileSize);                        \
+   template BasicRaster<uint8_t> ComputeFlowDirectionD8(const BasicRasterView<const T> &dem);                          \
+   template Raster               ComputeFlowDirectionDInf(const BasicRasterView<const T> &dem);
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
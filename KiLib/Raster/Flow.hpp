@@ -0,0 +1,139 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <KiLib/Raster/Raster.hpp>
+#include <cstdint>
+
+namespace KiLib
+{
+   // D8 flow directions, as used by ArcGIS. Rows count up from the bottom of the raster, so north is row + 1.
+   enum D8Direction : uint8_t
+   {
+      D8None      = 0,   // No lower neighbour (pits, flats and outlets)
+      D8East      = 1,
+      D8SouthEast = 2,
+      D8South     = 4,
+      D8SouthWest = 8,
+      D8West      = 16,
+      D8NorthWest = 32,
+      D8North     = 64,
+      D8NorthEast = 128,
+      D8NoData    = 255, // Nodata value of D8 direction rasters
+   };
+
+   /**
+    * @brief Fills the depressions of dem in place with the Priority-Flood of Barnes et al. (2014), so that every valid
+    * cell drains to the edge of the raster or to a nodata cell. With epsilon, filled depressions and flats of floating
+    * point rasters rise by the smallest representable step from cell to cell (Priority-Flood+Epsilon), so flow
+    * directions computed afterwards leave them; integer rasters are always filled flat. Besides its queues, the fill
+    * uses one byte per cell.
+    *
+    * With tileSize > 0, tiles of tileSize x tileSize cells are filled in parallel and the levels water spills at
+    * between them are resolved over a graph of their watersheds (Barnes, 2016). Flats then get their gradient from
+    * the cells they drain through. The fill levels are the same as without tiles; the epsilon steps may differ.
+    *
+    * Barnes, R., Lehman, C., Mulla, D. (2014), Priority-flood: An optimal depression-filling and watershed-labeling
+    * algorithm for digital elevation models. Computers & Geosciences, 62: 117-127.
+    * Barnes, R. (2016), Parallel priority-flood depression filling for trillion cell digital elevation models on
+    * desktops or clusters. Computers & Geosciences, 96: 56-68.
+    *
+    * @param dem Elevations, modified in place
+    * @param epsilon Whether filled cells get a gradient instead of staying flat
+    * @param tileSize Side of the tiles filled in parallel, 0 fills the raster at once
+    */
+   template <class T>
+   void FillDepressions(const BasicRasterView<T> &dem, bool epsilon = true, size_t tileSize = 0);
+
+   template <class T>
+   void FillDepressions(BasicRaster<T> &dem, bool epsilon = true, size_t tileSize = 0)
+   {
+      FillDepressions(dem.view(), epsilon, tileSize);
+   }
+
+   /**
+    * @brief D8 flow directions: every cell drains to the neighbour with the steepest drop. Neighbours outside of the
+    * raster or holding nodata are ignored.
+    *
+    * @param dem Elevations, depressions should be filled first
+    * @return BasicRaster<uint8_t> D8Direction of every cell, D8NoData where dem has nodata
+    */
+   template <class T>
+   BasicRaster<uint8_t> ComputeFlowDirectionD8(const BasicRasterView<const T> &dem);
+
+   template <class T>
+   BasicRaster<uint8_t> ComputeFlowDirectionD8(const BasicRaster<T> &dem)
+   {
+      return ComputeFlowDirectionD8(dem.view());
+   }
+
+   /**
+    * @brief D-infinity flow directions of Tarboton (1997): the direction of steepest descent over the 8 triangular
+    * facets around each cell. Flow is split between the two neighbours bounding that direction.
+    *
+    * @param dem Elevations, depressions should be filled first
+    * @return Raster [rad] Direction counterclockwise from east in [0, 2 pi), -1 where no neighbour is lower, nodata
+    * where dem has nodata
+    */
+   template <class T>
+   Raster ComputeFlowDirectionDInf(const BasicRasterView<const T> &dem);
+
+   template <class T>
+   Raster ComputeFlowDirectionDInf(const BasicRaster<T> &dem)
+   {
+      return ComputeFlowDirectionDInf(dem.view());
+   }
+
+   /**
+    * @brief Upslope area draining through every cell (including the cell itself) following D8 directions, in one
+    * linear-time topological sweep. With tileSize > 0, tiles of tileSize x tileSize cells are swept in parallel and
+    * the flows crossing tile boundaries are merged afterwards, which gives the same result.
+    *
+    * @param directions D8 directions, from ComputeFlowDirectionD8
+    * @param tileSize Side of the tiles swept in parallel, 0 sweeps the raster at once
+    * @return Raster [m^2] Accumulated area, nodata (-9999) where directions have nodata
+    */
+   Raster ComputeFlowAccumulationD8(const BasicRasterView<const uint8_t> &directions, size_t tileSize = 0);
+
+   /**
+    * @brief Upslope area draining through every cell (including the cell itself) following D-infinity directions, in
+    * one linear-time topological sweep
+    *
+    * @param directions D-infinity directions, from ComputeFlowDirectionDInf
+    * @return Raster [m^2] Accumulated area, nodata (-9999) where directions have nodata
+    */
+   Raster ComputeFlowAccumulationDInf(const RasterView &directions);
+
+   /**
+    * @brief Topographic wetness index ln(a / tan b) of Beven and Kirkby (1979), where a is the area draining through a
+    * cell per unit contour length (the cell size) and b is the slope angle
+    *
+    * @param dem Elevations the accumulation was computed from
+    * @param accumulation [m^2] Upslope area of every cell, from ComputeFlowAccumulationD8 or ComputeFlowAccumulationDInf
+    * @param method Method computing the slope of dem
+    * @param minSlope Smallest slope (rise over run) used, so that flats get a finite index
+    * @return Raster [-] Wetness index, nodata where dem or accumulation have nodata
+    */
+   Raster ComputeTopographicWetnessIndex(
+      const RasterView &dem, const RasterView &accumulation, Raster::SlopeMethod method = Raster::ZevenbergenThorne,
+      double minSlope = 1e-3);
+
+} // namespace KiLib
@@ -0,0 +1,271 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <KiLib/Raster/RasterView.hpp>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+// Inlines every call made by the vectorized loop of FocalApply. GCC and Clang otherwise keep larger kernels out of
+// line, and a call stops the loop from vectorizing.
+#if defined(__GNUC__)
+#define KILIB_FOCAL_FLATTEN __attribute__((flatten))
+#else
+#define KILIB_FOCAL_FLATTEN
+#endif
+
+namespace KiLib
+{
+   /**
+    * @brief Square neighbourhood of Radius cells around a cell, handed to focal kernels by FocalApply. Offsets are in
+    * cells, with rows counting up from the bottom of the raster, so (1, 0) is the northern neighbour and (0, 1) the
+    * eastern one.
+    *
+    * @tparam T Cell type of the input raster
+    * @tparam Radius Number of cells on each side of the centre
+    */
+   template <class T, int Radius>
+   class FocalWindow
+   {
+   public:
+      static constexpr int size = 2 * Radius + 1; // Number of rows and columns of the window
+
+      /**
+       * @brief Window centred on centre, whose rows are stride cells apart
+       *
+       * @param centre Centre cell
+       * @param stride Number of cells between two rows
+       * @param mask Validity of the cells, with the same layout as the window. nullptr when every cell is valid.
+       */
+      FocalWindow(const T *centre, long stride, const unsigned char *mask = nullptr)
+         : cells(centre), stride(stride), mask(mask)
+      {
+      }
+
+      /**
+       * @brief Value at offset (dr, dc) from the centre. Cells outside of the raster or holding nodata read as the
+       * centre value.
+       */
+      double operator()(int dr, int dc) const
+      {
+         return static_cast<double>(this->cells[dr * this->stride + dc]);
+      }
+
+      /**
+       * @brief Whether the cell at offset (dr, dc) is inside of the raster and holds data
+       */
+      bool valid(int dr, int dc) const
+      {
+         return this->mask == nullptr || this->mask[dr * this->stride + dc] != 0;
+      }
+
+      /**
+       * @brief Whether any cell of the window holds value. Unrolled at compile time so it vectorizes.
+       */
+      bool contains(double value) const
+      {
+         return this->contains(value, std::make_integer_sequence<int, size * size>());
+      }
+
+   private:
+      const T             *cells;
+      long                 stride;
+      const unsigned char *mask;
+
+      template <int... I>
+      bool contains(double value, std::integer_sequence<int, I...>) const
+      {
+         // Bitwise or, short-circuiting would add a branch per cell
+         return (... | ((*this)(I / size - Radius, I % size - Radius) == value));
+      }
+   };
+
+   /**
+    * @brief Applies a focal (neighbourhood) kernel with N outputs to every cell of inp, in one pass over it.
+    *
+    * The raster is split into tiles processed in parallel. Within a tile, cells whose whole window is inside of the
+    * raster and holds data go through a branch-free vectorized loop reading the input in place. Cells near the edges
+    * or next to nodata are then recomputed from a copy of their window where missing cells (outside of the raster or
+    * nodata) hold the centre value and are flagged as invalid. Cells that are nodata in inp are nodata in the outputs.
+    *
+    * Kernels provide
+    *    static constexpr int radius;
+    *    template <class W> std::array<double, N> operator()(const W &window) const;
+    * where window is a FocalWindow of the kernel radius. Kernels should not branch on the window values so the
+    * interior loop vectorizes.
+    *
+    * @param inp Input raster
+    * @param kernel Focal kernel
+    * @param outs Outputs with the size of inp, in the order of the kernel results. Must not overlap inp. Results for
+    * default constructed (empty) views are computed but not stored.
+    */
+   template <class T, class U, size_t N, class Kernel>
+   void FocalApply(
+      const BasicRasterView<const T> &inp, const Kernel &kernel, const std::array<BasicRasterView<U>, N> &outs)
+   {
+      constexpr int  R        = Kernel::radius;
+      constexpr int  size     = FocalWindow<T, R>::size;
+      constexpr long tileRows = 64;
+      constexpr long tileCols = 2048;
+      constexpr auto outputs  = std::make_index_sequence<N>();
+
+      for (const auto &out : outs)
+      {
+         if (out.data() != nullptr && (inp.nRows != out.nRows || inp.nCols != out.nCols))
+            throw std::invalid_argument("Focal outputs must have the size of their input");
+      }
+
+      const long   NR       = static_cast<long>(inp.nRows);
+      const long   NC       = static_cast<long>(inp.nCols);
+      const long   inStride = static_cast<long>(inp.stride);
+      const double nd       = inp.nodata_value;
+      const long   tilesR   = (NR + tileRows - 1) / tileRows;
+      const long   tilesC   = (NC + tileCols - 1) / tileCols;
+
+      std::array<U, N> outNd;
+      for (size_t k = 0; k < N; k++)
+         outNd[k] = static_cast<U>(outs[k].data() != nullptr ? outs[k].nodata_value : nd);
+
+#pragma omp parallel
+      {
+         // Cells of the current tile row the vectorized loop could not handle (non-zero). Flags are doubles so they
+         // share the lane width of the arithmetic and the loop vectorizes.
+         std::vector<double> fallback(tileCols);
+
+         // Row of a tile for results that are not stored
+         std::vector<U> discard(N * tileCols);
+
+         // Copy of the window of a cell with missing neighbours
+         std::vector<T>             values(size * size);
+         std::vector<unsigned char> mask(size * size);
+
+         // Where the current row of each output goes from the first column of the tile, indexed by column - c0 so no
+         // pointer is formed outside of the rows
+         std::array<U *, N> dst;
+
+         auto store = [&]<size_t... K>(const std::array<U *, N> &dst, long i, const auto &res, std::index_sequence<K...>)
+         { ((dst[K][i] = static_cast<U>(res[K])), ...); };
+
+         // Cells with missing neighbours or nodata themselves, i is the column within the tile
+         auto general = [&](long r, long c, long i)
+         {
+            const T centre = inp(r, c);
+            if (centre == nd)
+            {
+               store(dst, i, outNd, outputs);
+               return;
+            }
+
+            for (int dr = -R; dr <= R; dr++)
+            {
+               for (int dc = -R; dc <= R; dc++)
+               {
+                  const long rr = r + dr;
+                  const long cc = c + dc;
+                  const int  i  = (dr + R) * size + dc + R;
+                  mask[i]       = rr >= 0 && rr < NR && cc >= 0 && cc < NC && inp(rr, cc) != nd;
+                  values[i]     = mask[i] ? inp(rr, cc) : centre;
+               }
+            }
+
+            const int mid = R * size + R;
+            store(dst, i, kernel(FocalWindow<T, R>(&values[mid], size, &mask[mid])), outputs);
+         };
+
+         // Windows of the vectorized loop are built in these calls rather than in the loop body, an object declared
+         // in an omp simd loop is kept in memory per lane and stops the loop from vectorizing
+         auto interior = [&](const std::array<U *, N> &dst, long i, const T *centre) KILIB_FOCAL_FLATTEN
+         { store(dst, i, kernel(FocalWindow<T, R>(centre, inStride)), outputs); };
+         auto missing = [&](const T *centre) { return FocalWindow<T, R>(centre, inStride).contains(nd) ? 1.0 : 0.0; };
+
+#pragma omp for schedule(dynamic)
+         for (long tile = 0; tile < tilesR * tilesC; tile++)
+         {
+            const long r0 = (tile / tilesC) * tileRows;
+            const long r1 = std::min(r0 + tileRows, NR);
+            const long c0 = (tile % tilesC) * tileCols;
+            const long c1 = std::min(c0 + tileCols, NC);
+
+            // Columns of the tile whose window is inside of the raster
+            const long ci0 = std::max(c0, static_cast<long>(R));
+            const long ci1 = std::min(c1, NC - R);
+
+            for (long r = r0; r < r1; r++)
+            {
+               for (size_t k = 0; k < N; k++)
+                  dst[k] = outs[k].data() != nullptr ? &outs[k](r, c0) : discard.data() + k * tileCols;
+
+               std::fill(fallback.begin(), fallback.end(), 1.0);
+
+               if (r >= R && r < NR - R)
+               {
+                  const T *src = &inp(r, 0);
+                  double  *fb  = fallback.data();
+
+#pragma omp simd
+                  for (long c = ci0; c < ci1; c++)
+                  {
+                     interior(dst, c - c0, src + c);
+                     fb[c - c0] = missing(src + c);
+                  }
+               }
+
+               for (long c = c0; c < c1; c++)
+               {
+                  if (fallback[c - c0] != 0.0)
+                     general(r, c, c - c0);
+               }
+            }
+         }
+      }
+   }
+
+   // Adapts a kernel returning a double to the multiple output FocalApply
+   template <class Kernel>
+   struct FocalSingleOutput
+   {
+      static constexpr int radius = Kernel::radius;
+      const Kernel        &kernel;
+
+      template <class W>
+      std::array<double, 1> operator()(const W &window) const
+      {
+         return {this->kernel(window)};
+      }
+   };
+
+   /**
+    * @brief Applies a focal (neighbourhood) kernel with a single output to every cell of inp and writes the result to
+    * out. See the multiple output FocalApply, except that kernels return a double.
+    *
+    * @param inp Input raster
+    * @param kernel Focal kernel
+    * @param out Output raster with the size of inp. Must not overlap inp.
+    */
+   template <class T, class U, class Kernel>
+   void FocalApply(const BasicRasterView<const T> &inp, const Kernel &kernel, const BasicRasterView<U> &out)
+   {
+      FocalApply(inp, FocalSingleOutput<Kernel>{kernel}, std::array<BasicRasterView<U>, 1>{out});
+   }
+
+} // namespace KiLib
@@ -19,21 +19,84 @@
 
 
 #include <KiLib/Raster/Raster.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
 #include <fstream>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <spdlog/fmt/compile.h>
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
 #include <sstream>
+#include <string_view>
+
+static bool _IsBlank(char c)
+{
+   return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * @brief Parses one row of whitespace separated values
+ *
+ * @param first Start of the row
+ * @param last End of the row (exclusive)
+ * @param skip Number of leading values to skip without parsing them
+ * @param convert Conversion of the parsed values to cells
+ * @param out First cell of the row
+ * @param n Number of values expected after the skipped ones
+ * @return bool True if n values were parsed
+ */
+template <class T>
+static bool _ParseRow(
+   const char *first, const char *last, size_t skip, const KiLib::CellConverter<double, T> &convert, T *out, size_t n)
+{
+   for (size_t col = 0; col < skip; col++)
+   {
+      while (first != last && _IsBlank(*first))
+         first++;
+      if (first == last)
+         return false;
+      while (first != last && !_IsBlank(*first))
+         first++;
+   }
+
+   for (size_t col = 0; col < n; col++)
+   {
+      while (first != last && _IsBlank(*first))
+         first++;
+
+      // Always parse as double, values may be written with a fractional part whatever the cell type
+      double value = 0.0;
+#if defined(__cpp_lib_to_chars)
+      auto [ptr, ec] = std::from_chars(first, last, value);
+      if (ec != std::errc())
+         return false;
+#else
+      char *ptr = nullptr;
+      value     = std::strtod(first, &ptr);
+      if (ptr == first || ptr > last)
+         return false;
+#endif
+      first    = ptr;
+      out[col] = convert(value);
+   }
+   return true;
+}
 
 namespace KiLib
 {
-   void Raster::fromDEM(const std::string &path)
+   template <class T>
+   void BasicRaster<T>::fromDEM(const std::string &path, const WindowResolver &window)
    {
       std::ifstream      rasterFile;
       std::string        line, key;
       std::istringstream stream(line);
 
       // Open Elevation file
-      rasterFile.open(path, std::ios::in);
+      rasterFile.open(path, std::ios::in | std::ios::binary);
       if (!rasterFile.is_open())
       {
          spdlog::error("Failed to open {} for reading", path);
@@ -43,7 +106,7 @@ namespace KiLib
       // Load header
       for (int i = 0; i < 6; i++)
       {
-         getline(rasterFile, line);
+         std::getline(rasterFile, line);
          stream.str(line);
          stream.clear();
 
@@ -83,33 +146,82 @@ namespace KiLib
          }
       }
 
-      this->data.resize(nRows * nCols);
-      // Load elevations
-      for (size_t row = 0; row < this->nRows; row++)
+      this->width               = this->nCols * this->cellsize;
+      this->height              = this->nRows * this->cellsize;
+      this->nData               = this->nRows * this->nCols;
+      const RasterWindow region = ClipWindow(window(*this), this->nRows, this->nCols);
+
+      // The file starts with the top row, skip the rows above the window without parsing them
+      const size_t fileCols = this->nCols;
+      for (size_t row = region.row + region.nRows; row < this->nRows; row++)
       {
-         getline(rasterFile, line);
-         stream.str(line);
-         stream.clear();
+         rasterFile.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+      }
 
-         // Moving along a row (across columns) is movement through X
-         // Moving down a column (across rows) is movement through Y
-         for (size_t col = 0; col < this->nCols; col++)
-         {
-            double value;
-            stream >> value;
-            this->at(this->nRows - row - 1, col) = value;
-         }
+      // Read from the first row of the window in large blocks until its last row is complete, rows below the window
+      // are not read past the end of the block holding the last one
+      std::string  buf;
+      const size_t block = size_t{1} << 24;
+      size_t       found = 0;
+      while (found < region.nRows && rasterFile)
+      {
+         const size_t size = buf.size();
+         buf.resize(size + block);
+         rasterFile.read(buf.data() + size, static_cast<std::streamsize>(block));
+         buf.resize(size + static_cast<size_t>(rasterFile.gcount()));
+         found += static_cast<size_t>(std::count(buf.begin() + static_cast<long>(size), buf.end(), '\n'));
       }
+      rasterFile.close();
 
-      this->width  = this->nCols * this->cellsize;
-      this->height = this->nRows * this->cellsize;
-      this->nData  = this->nRows * this->nCols;
+      // Returns the line starting at pos and moves pos to the start of the next one. Lines stay separated by their
+      // '\n' in buf, so parsing one row never runs into the next
+      size_t pos      = 0;
+      auto   nextLine = [&]()
+      {
+         const size_t eol   = std::min(buf.find('\n', pos), buf.size());
+         const size_t begin = pos;
+         pos                = std::min(eol + 1, buf.size());
+         return std::string_view(buf).substr(begin, eol - begin);
+      };
 
-      rasterFile.close();
+      // Find every row first so they can be parsed independently
+      std::vector<std::string_view> rows(region.nRows);
+      for (size_t row = 0; row < region.nRows; row++)
+      {
+         rows[row] = nextLine();
+      }
+
+      this->applyWindow(region);
+      this->data.resize(nRows * nCols);
+
+      // Values are parsed as doubles whatever the cell type, nodata is replaced if T cannot hold it
+      const CellConverter<double, T> convert(this->nodata_value);
+      this->nodata_value = convert.nodata();
+
+      // Load elevations
+      // Moving along a row (across columns) is movement through X
+      // Moving down a column (across rows) is movement through Y
+      const long nRowsL = static_cast<long>(this->nRows);
+      bool       ok     = true;
+#pragma omp parallel for schedule(static) reduction(&& : ok)
+      for (long row = 0; row < nRowsL; row++)
+      {
+         const char *first = rows[row].data();
+         const char *last  = first + rows[row].size();
+         T          *out   = &this->data[(this->nRows - row - 1) * this->nCols];
+         ok                = _ParseRow(first, last, region.col, convert, out, this->nCols) && ok;
+      }
+
+      if (!ok)
+      {
+         spdlog::error("Failed to read {} values per row from {}", fileCols, path);
+         exit(EXIT_FAILURE);
+      }
    }
 
 
-   void Raster::toDEM(const std::string &path) const
+   template <class T>
+   void BasicRaster<T>::toDEM(const std::string &path) const
    {
       std::ofstream outFile = std::ofstream(path);
       if (!outFile.is_open())
@@ -128,24 +240,60 @@ namespace KiLib
          "NODATA_value {}\n",
          this->nCols, this->nRows, this->xllcorner, this->yllcorner, this->cellsize, this->nodata_value);
 
-      for (size_t row = 1; row <= this->nRows; row++)
+      // Rows are formatted in parallel a batch of roughly 16 MiB at a time, then written in order
+#ifdef _OPENMP
+      const size_t threads = static_cast<size_t>(omp_get_max_threads());
+#else
+      const size_t threads = 1;
+#endif
+      const size_t batch = std::max(threads, (size_t{1} << 24) / std::max<size_t>(1, 16 * this->nCols));
+
+      std::vector<fmt::memory_buffer> rows(std::min(batch, this->nRows));
+
+      for (size_t first = 0; first < this->nRows; first += batch)
       {
-         for (size_t col = 0; col < this->nCols; col++)
+         const long count = static_cast<long>(std::min(batch, this->nRows - first));
+
+#pragma omp parallel for schedule(dynamic)
+         for (long i = 0; i < count; i++)
          {
-            double val = this->operator()(this->nRows - row, col);
+            const size_t        row = first + i + 1;
+            fmt::memory_buffer &out = rows[i];
+            out.clear();
 
-            if (val == this->nodata_value)
-            {
-               fmt::print(outFile, "{} ", this->nodata_value);
-            }
-            else
+            for (size_t col = 0; col < this->nCols; col++)
             {
-               fmt::print(outFile, "{: .8f} ", val);
+               T val = this->operator()(this->nRows - row, col);
+
+               if (val == this->nodata_value)
+               {
+                  fmt::format_to(std::back_inserter(out), "{} ", this->nodata_value);
+               }
+               else if constexpr (std::is_floating_point_v<T>)
+               {
+                  fmt::format_to(std::back_inserter(out), FMT_COMPILE("{: .8f} "), val);
+               }
+               else
+               {
+                  fmt::format_to(std::back_inserter(out), FMT_COMPILE("{} "), val);
+               }
             }
+            out.push_back('\n');
+         }
+
+         for (long i = 0; i < count; i++)
+         {
+            outFile.write(rows[i].data(), static_cast<std::streamsize>(rows[i].size()));
          }
-         fmt::print(outFile, "\n");
       }
 
       outFile.close();
    }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template void BasicRaster<T>::fromDEM(const std::string &path, const WindowResolver &window);                      \
+   template void BasicRaster<T>::toDEM(const std::string &path) const;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
 } // namespace KiLib
\ No newline at end of file
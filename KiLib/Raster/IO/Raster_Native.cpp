@@ -0,0 +1,285 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <KiLib/Raster/MappedRaster.hpp>
+#include <KiLib/Raster/Raster.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <type_traits>
+
+// Native raster files start with this header, followed by padding up to offset and the cells in memory order
+// (row 0, the bottom row, first) in the byte order of the machine that wrote them
+struct _NativeHeader
+{
+   char     magic[8];     // _NativeMagic
+   uint32_t version;      // Format version, _NativeVersion when written
+   uint32_t byteOrder;    // _NativeByteOrder as written, detects files from machines of another endianness
+   uint16_t format;       // 1 unsigned integer, 2 signed integer, 3 floating point (as TIFFTAG_SAMPLEFORMAT)
+   uint16_t bps;          // Bits per sample
+   uint32_t reserved;     // Zero
+   uint64_t nRows;        // Number of rows (y)
+   uint64_t nCols;        // Number of columns (x)
+   double   xllcorner;    // Lower left corner x value in absolute coordinates
+   double   yllcorner;    // Lower left corner y value in absolute coordinates
+   double   cellsize;     // Distance between values
+   double   nodata_value; // Value associated with no data
+   uint64_t offset;       // Start of the cells from the start of the file
+};
+static_assert(sizeof(_NativeHeader) == 80, "Native raster header must not be padded");
+
+static constexpr char     _NativeMagic[8]  = {'K', 'I', 'R', 'A', 'S', 'T', 'E', 'R'};
+static constexpr uint32_t _NativeVersion   = 1;
+static constexpr uint32_t _NativeByteOrder = 0x01020304;
+
+// Cells start on a page boundary so the mapping is aligned for any cell type and vector loads
+static constexpr uint64_t _NativeAlignment = 4096;
+
+template <class T>
+static constexpr uint16_t _NativeFormat()
+{
+   return std::is_floating_point_v<T> ? 3 : (std::is_signed_v<T> ? 2 : 1);
+}
+
+/**
+ * @brief Validates the header of a mapped native raster, exits if the file is not one this version can read
+ *
+ * @param file Mapped file
+ * @param path Path of the file, for error messages
+ * @return _NativeHeader Header of the file
+ */
+static _NativeHeader _ReadNativeHeader(const KiLib::MappedFile &file, const std::string &path)
+{
+   _NativeHeader header;
+   if (file.size() < sizeof(header))
+   {
+      spdlog::error("{} is too small to be a native raster", path);
+      exit(EXIT_FAILURE);
+   }
+   std::memcpy(&header, file.data(), sizeof(header));
+
+   if (std::memcmp(header.magic, _NativeMagic, sizeof(_NativeMagic)) != 0)
+   {
+      spdlog::error("{} is not a native raster", path);
+      exit(EXIT_FAILURE);
+   }
+   if (header.version > _NativeVersion)
+   {
+      spdlog::error(
+         "{} uses native raster version {}, only up to {} is supported", path, header.version, _NativeVersion);
+      exit(EXIT_FAILURE);
+   }
+   if (header.byteOrder != _NativeByteOrder)
+   {
+      spdlog::error("{} was written on a machine with a different byte order", path);
+      exit(EXIT_FAILURE);
+   }
+
+   if (header.bps != 8 && header.bps != 16 && header.bps != 32 && header.bps != 64)
+   {
+      spdlog::error("{} has {}-bit cells, which native rasters do not store", path, header.bps);
+      exit(EXIT_FAILURE);
+   }
+   if (header.offset < sizeof(header) || header.offset % _NativeAlignment != 0)
+   {
+      spdlog::error("{} does not start its cells on a {}-byte boundary", path, _NativeAlignment);
+      exit(EXIT_FAILURE);
+   }
+
+   // Sizes are checked by division so corrupt dimensions cannot wrap around and pass for a small file
+   const uint64_t cellBytes = header.bps / 8;
+   const uint64_t maxCells  = std::numeric_limits<uint64_t>::max() / cellBytes;
+   if ((header.nCols != 0 && header.nRows > maxCells / header.nCols) || header.offset > file.size() ||
+       (file.size() - header.offset) / cellBytes < header.nRows * header.nCols)
+   {
+      spdlog::error("{} is truncated", path);
+      exit(EXIT_FAILURE);
+   }
+
+   return header;
+}
+
+/**
+ * @brief Calls f with a value of the cell type of a native raster, so it can be converted from with CellConverter
+ *
+ * @param header Header of the file
+ * @param f Callable taking a cell
+ * @return bool False if the sample type of the file is unknown
+ */
+template <class F>
+static bool _VisitNativeType(const _NativeHeader &header, F &&f)
+{
+   switch (header.format * 100 + header.bps)
+   {
+   case 364:
+      f(double());
+      return true;
+   case 332:
+      f(float());
+      return true;
+   case 232:
+      f(int32_t());
+      return true;
+   case 216:
+      f(int16_t());
+      return true;
+   case 116:
+      f(uint16_t());
+      return true;
+   case 108:
+      f(uint8_t());
+      return true;
+   default:
+      return false;
+   }
+}
+
+namespace KiLib
+{
+   template <class T>
+   void BasicRaster<T>::fromNative(const std::string &path, const WindowResolver &window)
+   {
+      const MappedFile    file(path);
+      const _NativeHeader header = _ReadNativeHeader(file, path);
+
+      this->nRows        = header.nRows;
+      this->nCols        = header.nCols;
+      this->xllcorner    = header.xllcorner;
+      this->yllcorner    = header.yllcorner;
+      this->cellsize     = header.cellsize;
+      this->nodata_value = header.nodata_value;
+      this->width        = this->nCols * this->cellsize;
+      this->height       = this->nRows * this->cellsize;
+      this->nData        = this->nRows * this->nCols;
+
+      const RasterWindow region = ClipWindow(window(*this), this->nRows, this->nCols);
+      const size_t       cols = this->nCols;
+      this->applyWindow(region);
+      this->data.resize(this->nData);
+
+      // Rows are stored in memory order, so only the rows of the window are touched. Cells of another type are
+      // converted, nodata is replaced if T cannot hold it
+      const size_t bytes = header.bps / 8;
+      const bool   known = _VisitNativeType(
+         header,
+         [&](auto sample)
+         {
+            using S = decltype(sample);
+            const CellConverter<S, T> convert(header.nodata_value);
+            for (size_t row = 0; row < this->nRows; row++)
+            {
+               const std::byte *src = file.data() + header.offset + ((region.row + row) * cols + region.col) * bytes;
+               convert(reinterpret_cast<const S *>(src), &this->data[row * this->nCols], this->nCols);
+            }
+            this->nodata_value = convert.nodata();
+         });
+
+      if (!known)
+      {
+         spdlog::error("Unknown data format.");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   template <class T>
+   void BasicRaster<T>::toNative(const std::string &path) const
+   {
+      std::ofstream outFile(path, std::ios::out | std::ios::binary);
+      if (!outFile.is_open())
+      {
+         spdlog::error("Cannot open output {}", path);
+         exit(EXIT_FAILURE);
+      }
+
+      _NativeHeader header = {};
+      std::memcpy(header.magic, _NativeMagic, sizeof(_NativeMagic));
+      header.version      = _NativeVersion;
+      header.byteOrder    = _NativeByteOrder;
+      header.format       = _NativeFormat<T>();
+      header.bps          = sizeof(T) * 8;
+      header.nRows        = this->nRows;
+      header.nCols        = this->nCols;
+      header.xllcorner    = this->xllcorner;
+      header.yllcorner    = this->yllcorner;
+      header.cellsize     = this->cellsize;
+      header.nodata_value = this->nodata_value;
+      header.offset       = _NativeAlignment;
+
+      const std::vector<char> padding(_NativeAlignment - sizeof(header), 0);
+      outFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      outFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+      outFile.write(
+         reinterpret_cast<const char *>(this->data.data()), static_cast<std::streamsize>(this->nData * sizeof(T)));
+
+      if (!outFile)
+      {
+         spdlog::error("Failed to write data to {}", path);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   template <class T>
+   BasicMappedRaster<T>::BasicMappedRaster(const std::string &path) : file(path)
+   {
+      const _NativeHeader header = _ReadNativeHeader(this->file, path);
+      if (header.format != _NativeFormat<T>() || header.bps != sizeof(T) * 8)
+      {
+         spdlog::error("{} does not hold {}-bit cells of the mapped raster type", path, sizeof(T) * 8);
+         exit(EXIT_FAILURE);
+      }
+
+      this->nRows        = header.nRows;
+      this->nCols        = header.nCols;
+      this->nData        = this->nRows * this->nCols;
+      this->xllcorner    = header.xllcorner;
+      this->yllcorner    = header.yllcorner;
+      this->cellsize     = header.cellsize;
+      this->nodata_value = header.nodata_value;
+      this->width        = this->nCols * this->cellsize;
+      this->height       = this->nRows * this->cellsize;
+      this->cells        = reinterpret_cast<const T *>(this->file.data() + header.offset);
+   }
+
+   template <class T>
+   T BasicMappedRaster<T>::at(size_t row, size_t col) const
+   {
+      return this->at(row * this->nCols + col);
+   }
+
+   template <class T>
+   T BasicMappedRaster<T>::at(size_t ind) const
+   {
+      if (ind >= this->nData)
+         throw std::out_of_range(fmt::format("Index {} is out of range of a raster of {} cells", ind, this->nData));
+      return this->cells[ind];
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template void BasicRaster<T>::fromNative(const std::string &path, const WindowResolver &window);                   \
+   template void BasicRaster<T>::toNative(const std::string &path) const;                                             \
+   template class BasicMappedRaster<T>;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
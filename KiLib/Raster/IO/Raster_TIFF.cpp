@@ -19,7 +19,10 @@
 
 
 #include <KiLib/Raster/Raster.hpp>
+#include <algorithm>
+#include <cstring>
 #include <tiffio.hxx>
+#include <type_traits>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -84,10 +87,435 @@ static void _XTIFFInitialize(void)
    _ParentExtender = TIFFSetTagExtender(_XTIFFDefaultDirectory);
 }
 
+/**
+ * @brief TIFF sample format matching a raster cell type
+ *
+ * @tparam T Cell type
+ * @return uint16_t Value for TIFFTAG_SAMPLEFORMAT
+ */
+template <class T>
+static constexpr uint16_t _SampleFormat()
+{
+   if constexpr (std::is_floating_point_v<T>)
+      return SAMPLEFORMAT_IEEEFP;
+   else if constexpr (std::is_signed_v<T>)
+      return SAMPLEFORMAT_INT;
+   else
+      return SAMPLEFORMAT_UINT;
+}
+
+/**
+ * @brief Converts n contiguous samples stored as S into cells of type T
+ *
+ * @tparam S Sample type in the file
+ * @tparam T Cell type of the raster
+ * @param in Decoded samples
+ * @param out First cell to write
+ * @param n Number of samples
+ * @param nodata Nodata value of the file
+ */
+template <class S, class T>
+static void _ConvertSamples(const void *in, T *out, size_t n, double nodata)
+{
+   const KiLib::CellConverter<S, T> convert(nodata);
+   convert(static_cast<const S *>(in), out, n);
+}
+
+template <class T>
+using _SampleKernel = void (*)(const void *, T *, size_t, double);
+
+/**
+ * @brief Returns the conversion kernel from S to T and replaces nodata by the nodata value of the converted cells
+ */
+template <class S, class T>
+static _SampleKernel<T> _SampleKernelFor(double &nodata)
+{
+   nodata = KiLib::CellConverter<S, T>(nodata).nodata();
+   return _ConvertSamples<S, T>;
+}
+
+/**
+ * @brief Picks the conversion kernel for a file's sample format once, so decoding loops never branch on it
+ *
+ * @param format TIFFTAG_SAMPLEFORMAT of the file
+ * @param bps TIFFTAG_BITSPERSAMPLE of the file
+ * @param nodata Nodata value of the file, replaced by the nodata value of the converted cells
+ * @return _SampleKernel<T> Kernel, or nullptr if the combination is not supported
+ */
+template <class T>
+static _SampleKernel<T> _SelectSampleKernel(uint16_t format, uint16_t bps, double &nodata)
+{
+   switch (format)
+   {
+   case SAMPLEFORMAT_UINT:
+      switch (bps)
+      {
+      case 8:
+         return _SampleKernelFor<uint8_t, T>(nodata);
+      case 16:
+         return _SampleKernelFor<uint16_t, T>(nodata);
+      case 32:
+         return _SampleKernelFor<uint32_t, T>(nodata);
+      case 64:
+         return _SampleKernelFor<uint64_t, T>(nodata);
+      }
+      break;
+   case SAMPLEFORMAT_INT:
+      switch (bps)
+      {
+      case 8:
+         return _SampleKernelFor<int8_t, T>(nodata);
+      case 16:
+         return _SampleKernelFor<int16_t, T>(nodata);
+      case 32:
+         return _SampleKernelFor<int32_t, T>(nodata);
+      case 64:
+         return _SampleKernelFor<int64_t, T>(nodata);
+      }
+      break;
+   case SAMPLEFORMAT_IEEEFP:
+      switch (bps)
+      {
+      case 32:
+         return _SampleKernelFor<float, T>(nodata);
+      case 64:
+         return _SampleKernelFor<double, T>(nodata);
+      }
+      break;
+   }
+   return nullptr;
+}
+
+/**
+ * @brief Decodes every strip or tile of a TIFF into rast, flipping rows so that row 0 is the bottom of the raster.
+ * A strip is treated as a block as wide as the image. libtiff handles are not thread safe, so each OpenMP thread
+ * opens its own handle and decodes a share of the blocks.
+ *
+ * @param path File to read
+ * @param tiled Whether the file is organised in tiles rather than strips
+ * @param w Image width of the file
+ * @param h Image length of the file
+ * @param bw Block width (tile width, or image width for strips)
+ * @param bh Block length (tile length, or rows per strip)
+ * @param bps TIFFTAG_BITSPERSAMPLE of the file
+ * @param kernel Sample conversion kernel from _SelectSampleKernel
+ * @param nodata Nodata value of the file
+ * @param window Part of the file to read, only the blocks overlapping it are decoded
+ * @param rast Raster with the metadata of window set and data allocated
+ * @return bool True if every block was decoded
+ */
+template <class T>
+static bool _ReadBlocks(
+   const std::string &path, bool tiled, uint32_t w, uint32_t h, uint32_t bw, uint32_t bh, uint16_t bps,
+   _SampleKernel<T> kernel, double nodata, const KiLib::RasterWindow &window, KiLib::BasicRaster<T> &rast)
+{
+   // The file stores the top row first, so the window covers file rows [top, top + nRows)
+   const size_t top          = h - window.row - window.nRows;
+   const size_t blocksAcross = (w + bw - 1) / bw;
+   const size_t bx0          = window.col / bw;
+   const size_t bx1          = (window.col + window.nCols - 1) / bw;
+   const size_t by0          = top / bh;
+   const size_t by1          = (top + window.nRows - 1) / bh;
+   const size_t across       = bx1 - bx0 + 1;
+   const long   nBlocks      = static_cast<long>(across * (by1 - by0 + 1));
+   const size_t sampleBytes  = bps / 8;
+   const size_t rowBytes     = static_cast<size_t>(bw) * sampleBytes;
+   bool         ok           = true;
+
+#pragma omp parallel reduction(&& : ok)
+   {
+      TIFF   *tiff = TIFFOpen(path.c_str(), "r");
+      tdata_t buf  = nullptr;
+
+      if (tiff != NULL)
+         buf = _TIFFmalloc(tiled ? TIFFTileSize(tiff) : TIFFStripSize(tiff));
+
+      ok = (buf != nullptr);
+
+#pragma omp for schedule(dynamic)
+      for (long block = 0; block < nBlocks; block++)
+      {
+         if (!ok)
+            continue;
+
+         // Blocks are numbered left to right, top to bottom. Edge blocks are padded past the image bounds.
+         const size_t   by = by0 + block / across;
+         const size_t   bx = bx0 + block % across;
+         const uint32_t id = static_cast<uint32_t>(by * blocksAcross + bx);
+         if ((tiled ? TIFFReadEncodedTile(tiff, id, buf, -1) : TIFFReadEncodedStrip(tiff, id, buf, -1)) == -1)
+         {
+            ok = false;
+            continue;
+         }
+
+         // Intersection of the block and the window, in file rows and columns
+         const size_t row0 = std::max(by * bh, top);
+         const size_t row1 = std::min({(by + 1) * bh, top + window.nRows, static_cast<size_t>(h)});
+         const size_t col0 = std::max(bx * bw, window.col);
+         const size_t col1 = std::min({(bx + 1) * bw, window.col + window.nCols, static_cast<size_t>(w)});
+
+         for (size_t r = row0; r < row1; r++)
+            kernel(
+               static_cast<const uint8_t *>(buf) + (r - by * bh) * rowBytes + (col0 - bx * bw) * sampleBytes,
+               &rast.data[(top + window.nRows - r - 1) * rast.nCols + (col0 - window.col)], col1 - col0, nodata);
+      }
+
+      if (buf != nullptr)
+         _TIFFfree(buf);
+      if (tiff != NULL)
+         TIFFClose(tiff);
+   }
+
+   return ok;
+}
+
+/**
+ * @brief Sample layout and codec settings of a GeoTIFF being written. Shared by the output file and the in-memory
+ * files its blocks are compressed in.
+ */
+struct _TiffLayout
+{
+   bool     tiled;       // Tiles rather than strips
+   uint32_t bw;          // Block width (tile width, or image width for strips)
+   uint32_t bh;          // Block length (tile length, or rows per strip)
+   uint16_t bps;         // TIFFTAG_BITSPERSAMPLE
+   uint16_t format;      // TIFFTAG_SAMPLEFORMAT
+   uint16_t compression; // TIFFTAG_COMPRESSION
+   uint16_t predictor;   // TIFFTAG_PREDICTOR, only set when compressing
+   int      level;       // Codec level, 0 keeps the codec default
+};
+
+/**
+ * @brief Sets the image, sample and codec tags of layout on a TIFF opened for writing
+ *
+ * @param tiff TIFF handle
+ * @param layout Layout to apply
+ * @param w Image width
+ * @param h Image length
+ */
+static void _SetLayoutTags(TIFF *tiff, const _TiffLayout &layout, uint32_t w, uint32_t h)
+{
+   TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, w);
+   TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, h);
+   TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, layout.bps);
+   TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 1);
+   TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, layout.format);
+   TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+   TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+
+   // Codec specific tags are only known once the compression is set
+   TIFFSetField(tiff, TIFFTAG_COMPRESSION, layout.compression);
+   if (layout.compression != COMPRESSION_NONE)
+      TIFFSetField(tiff, TIFFTAG_PREDICTOR, layout.predictor);
+   if (layout.level > 0 && layout.compression == COMPRESSION_ADOBE_DEFLATE)
+      TIFFSetField(tiff, TIFFTAG_ZIPQUALITY, layout.level);
+   if (layout.level > 0 && layout.compression == COMPRESSION_ZSTD)
+      TIFFSetField(tiff, TIFFTAG_ZSTD_LEVEL, layout.level);
+
+   if (layout.tiled)
+   {
+      TIFFSetField(tiff, TIFFTAG_TILEWIDTH, layout.bw);
+      TIFFSetField(tiff, TIFFTAG_TILELENGTH, layout.bh);
+   }
+   else
+   {
+      TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, layout.bh);
+   }
+}
+
+/**
+ * @brief Growable in-memory file backing a TIFF opened with TIFFClientOpen
+ */
+struct _MemFile
+{
+   std::vector<uint8_t> bytes;
+   toff_t               pos = 0;
+};
+
+static tmsize_t _MemRead(thandle_t handle, void *buf, tmsize_t size)
+{
+   _MemFile    *mem   = static_cast<_MemFile *>(handle);
+   const size_t avail = mem->pos < mem->bytes.size() ? mem->bytes.size() - mem->pos : 0;
+
+   size = std::min<tmsize_t>(size, static_cast<tmsize_t>(avail));
+   if (size > 0)
+      std::memcpy(buf, mem->bytes.data() + mem->pos, size);
+   mem->pos += size;
+   return size;
+}
+
+static tmsize_t _MemWrite(thandle_t handle, void *buf, tmsize_t size)
+{
+   _MemFile *mem = static_cast<_MemFile *>(handle);
+   if (mem->pos + size > mem->bytes.size())
+      mem->bytes.resize(mem->pos + size);
+   std::memcpy(mem->bytes.data() + mem->pos, buf, size);
+   mem->pos += size;
+   return size;
+}
+
+static toff_t _MemSeek(thandle_t handle, toff_t off, int whence)
+{
+   _MemFile *mem = static_cast<_MemFile *>(handle);
+   if (whence == SEEK_SET)
+      mem->pos = off;
+   else if (whence == SEEK_CUR)
+      mem->pos += off;
+   else
+      mem->pos = mem->bytes.size() + off;
+   return mem->pos;
+}
+
+static int _MemClose(thandle_t)
+{
+   return 0;
+}
+
+static toff_t _MemSize(thandle_t handle)
+{
+   return static_cast<_MemFile *>(handle)->bytes.size();
+}
+
+static int _MemMap(thandle_t, void **, toff_t *)
+{
+   return 0;
+}
+
+static void _MemUnmap(thandle_t, void *, toff_t)
+{
+}
+
+/**
+ * @brief Compresses a single strip or tile by writing it to an in-memory TIFF with the same layout and copying the
+ * encoded bytes back out. Unlike libtiff's own encoding this can run on many blocks concurrently, leaving only the raw
+ * writes to the real file to be done in order.
+ *
+ * @param layout Layout of the output file
+ * @param h Rows in the block (the full tile length for tiles)
+ * @param buf Samples of the block. May be modified by the predictor.
+ * @param size Size of buf in bytes
+ * @param out Encoded block
+ * @return bool True if the block was encoded
+ */
+static bool _EncodeBlock(const _TiffLayout &layout, uint32_t h, void *buf, tmsize_t size, std::vector<uint8_t> &out)
+{
+   _MemFile mem;
+   TIFF    *tiff = TIFFClientOpen(
+      "KiLib block", "w", &mem, _MemRead, _MemWrite, _MemSeek, _MemClose, _MemSize, _MemMap, _MemUnmap);
+
+   if (tiff == NULL)
+      return false;
+
+   _SetLayoutTags(tiff, layout, layout.bw, h);
+
+   bool ok = (layout.tiled ? TIFFWriteEncodedTile(tiff, 0, buf, size) : TIFFWriteEncodedStrip(tiff, 0, buf, size)) != -1;
+   if (ok)
+   {
+      const uint64_t offset = TIFFGetStrileOffset(tiff, 0);
+      const uint64_t count  = TIFFGetStrileByteCount(tiff, 0);
+      out.assign(mem.bytes.begin() + offset, mem.bytes.begin() + offset + count);
+   }
+
+   TIFFClose(tiff);
+   return ok;
+}
+
+/**
+ * @brief Writes rast to an opened TIFF block by block. Blocks are converted to S with CellConverter and, when
+ * compressing, encoded on all OpenMP threads a batch at a time. Only the raw writes of each batch are serialized.
+ *
+ * @tparam S Sample type stored in the file
+ * @param tiff TIFF opened for writing with the tags of layout set
+ * @param layout Layout of the file
+ * @param rast Raster to write
+ * @return bool True if every block was written
+ */
+template <class S, class T>
+static bool _WriteBlocks(TIFF *tiff, const _TiffLayout &layout, const KiLib::BasicRaster<T> &rast)
+{
+   const size_t blocksAcross = (rast.nCols + layout.bw - 1) / layout.bw;
+   const size_t blocksDown   = (rast.nRows + layout.bh - 1) / layout.bh;
+   const long   nBlocks      = static_cast<long>(blocksAcross * blocksDown);
+   const size_t blockSize    = static_cast<size_t>(layout.bw) * layout.bh;
+
+   const KiLib::CellConverter<T, S> convert(rast.nodata_value);
+
+   // Fills buf with the samples of a block, top row first, and returns the number of rows it holds. Tiles hanging
+   // over the image bounds are padded with nodata.
+   auto fill = [&](long block, S *buf)
+   {
+      const size_t row0 = (block / blocksAcross) * layout.bh;
+      const size_t col0 = (block % blocksAcross) * layout.bw;
+      const size_t rows = std::min<size_t>(layout.bh, rast.nRows - row0);
+      const size_t cols = std::min<size_t>(layout.bw, rast.nCols - col0);
+
+      if (layout.tiled)
+         std::fill(buf, buf + blockSize, convert.nodataCell());
+
+      for (size_t r = 0; r < rows; r++)
+         convert(&rast.data[(rast.nRows - row0 - r - 1) * rast.nCols + col0], buf + r * layout.bw, cols);
+      return static_cast<uint32_t>(layout.tiled ? layout.bh : rows);
+   };
+
+   if (layout.compression == COMPRESSION_NONE)
+   {
+      std::vector<S> buf(blockSize);
+      for (long block = 0; block < nBlocks; block++)
+      {
+         const tmsize_t size = static_cast<tmsize_t>(fill(block, buf.data()) * layout.bw * sizeof(S));
+         const uint32_t id   = static_cast<uint32_t>(block);
+         if ((layout.tiled ? TIFFWriteEncodedTile(tiff, id, buf.data(), size)
+                           : TIFFWriteEncodedStrip(tiff, id, buf.data(), size)) == -1)
+            return false;
+      }
+      return true;
+   }
+
+#ifdef _OPENMP
+   const long batch = 4 * omp_get_max_threads();
+#else
+   const long batch = 1;
+#endif
+   std::vector<std::vector<uint8_t>> encoded(batch);
+
+   for (long first = 0; first < nBlocks; first += batch)
+   {
+      const long last = std::min(first + batch, nBlocks);
+      bool       ok   = true;
+
+#pragma omp parallel reduction(&& : ok)
+      {
+         std::vector<S> buf(blockSize);
+
+#pragma omp for schedule(dynamic)
+         for (long block = first; block < last; block++)
+         {
+            const uint32_t h = fill(block, buf.data());
+            ok = ok && _EncodeBlock(layout, h, buf.data(), h * layout.bw * sizeof(S), encoded[block - first]);
+         }
+      }
+
+      if (!ok)
+         return false;
+
+      for (long block = first; block < last; block++)
+      {
+         std::vector<uint8_t> &bytes = encoded[block - first];
+         const uint32_t        id    = static_cast<uint32_t>(block);
+         if ((layout.tiled ? TIFFWriteRawTile(tiff, id, bytes.data(), bytes.size())
+                           : TIFFWriteRawStrip(tiff, id, bytes.data(), bytes.size())) == -1)
+            return false;
+      }
+   }
+
+   return true;
+}
+
 namespace KiLib
 {
 
-   void Raster::fromTiff(const std::string &path)
+   template <class T>
+   void BasicRaster<T>::fromTiff(const std::string &path, const WindowResolver &window)
    {
       _XTIFFInitialize();
 
@@ -158,77 +586,6 @@ namespace KiLib
       this->nodata_value = std::stod(nodat);
 
       this->nData = this->nRows * this->nCols;
-      this->data.resize(this->nData);
-
-      if (TIFFIsTiled(tiff))
-      {
-         spdlog::error("There is no support for tiled images yet.");
-         exit(EXIT_FAILURE);
-      }
-      else
-      {
-         uint16_t bps = 1;
-
-         // Format is currently undefined: https://www.awaresystems.be/imaging/tiff/tifftags/sampleformat.html
-         uint16_t format = 4;
-
-         // The number of bytes a strip occupies
-         uint64_t sls = TIFFScanlineSize64(tiff);
-
-         TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bps);
-         TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &format);
-
-         tdata_t buf = _TIFFmalloc((signed int)sls);
-         for (size_t row = 0; row < this->nRows; row++)
-         {
-
-            if (TIFFReadScanline(tiff, buf, row) == -1)
-            {
-               spdlog::error("Error when reading scanline");
-               exit(EXIT_FAILURE);
-            }
-
-            for (size_t col = 0; col < this->nCols; col++)
-            {
-               double val = 0;
-
-               switch (format)
-               {
-               case 1:
-                  if (bps == 8)
-                     val = (double)((uint8_t *)buf)[col];
-                  else if (bps == 16)
-                     val = (double)((uint16_t *)buf)[col];
-                  else if (bps == 32)
-                     val = (double)((uint32_t *)buf)[col];
-                  else
-                     val = (double)((uint64_t *)buf)[col];
-                  break;
-               case 2:
-                  if (bps == 8)
-                     val = (double)((int8_t *)buf)[col];
-                  else if (bps == 16)
-                     val = (double)((int16_t *)buf)[col];
-                  else if (bps == 32)
-                     val = (double)((int32_t *)buf)[col];
-                  else
-                     val = (double)((int64_t *)buf)[col];
-                  break;
-               case 3:
-                  if (bps == 32)
-                     val = (double)((float *)buf)[col];
-                  else
-                     val = ((double *)buf)[col];
-                  break;
-               default:
-                  spdlog::error("Unknown data format.");
-                  exit(EXIT_FAILURE);
-               }
-               this->at(this->nRows - row - 1, col) = val;
-            }
-         }
-         _TIFFfree(buf);
-      }
 
       // Remember to free necessary variables
       if (free_flag & 1)
@@ -242,10 +599,63 @@ namespace KiLib
       if (free_flag & 4)
          delete nodat;
 
+      RasterWindow region;
+      try
+      {
+         region = ClipWindow(window(*this), this->nRows, this->nCols);
+      }
+      catch (...)
+      {
+         TIFFClose(tiff);
+         throw;
+      }
+      this->applyWindow(region);
+      this->data.resize(this->nData);
+
+      uint16_t bps = 1;
+
+      // Format is currently undefined: https://www.awaresystems.be/imaging/tiff/tifftags/sampleformat.html
+      uint16_t format = 4;
+
+      TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bps);
+      TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+
+      // Samples are converted to T, nodata is replaced if T cannot hold it
+      const double fileNodata = this->nodata_value;
+      const auto   kernel     = _SelectSampleKernel<T>(format, bps, this->nodata_value);
+      if (kernel == nullptr)
+      {
+         spdlog::error("Unknown data format.");
+         exit(EXIT_FAILURE);
+      }
+
+      const bool tiled = TIFFIsTiled(tiff);
+      uint32_t   bw    = w;
+      uint32_t   bh    = h;
+
+      if (tiled && !(TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &bw) && TIFFGetField(tiff, TIFFTAG_TILELENGTH, &bh)))
+      {
+         spdlog::error("Failed to read tile width or tile length.");
+         exit(EXIT_FAILURE);
+      }
+      if (!tiled)
+      {
+         // A missing tag means the whole image is a single strip
+         TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &bh);
+         bh = std::min(bh, h);
+      }
+
+      if (!_ReadBlocks(path, tiled, w, h, bw, bh, bps, kernel, fileNodata, region, *this))
+      {
+         spdlog::error("Error when reading {} of {}", tiled ? "tiles" : "strips", path);
+         exit(EXIT_FAILURE);
+      }
+
       TIFFClose(tiff);
    }
 
-   void Raster::toTiff(const std::string &path) const
+   template <class T>
+   void BasicRaster<T>::toTiff(const std::string &path, const TiffOptions &options) const
    {
       // clang-format off
         // Key Directory
@@ -269,6 +679,59 @@ namespace KiLib
       // model tiepoint values
       double mtp[6] = {0.0, 0.0, 0.0, this->xllcorner, this->yllcorner + (this->nRows * this->cellsize), 0.0};
 
+      _TiffLayout layout;
+      layout.tiled  = options.tileSize > 0;
+      layout.bps    = static_cast<uint16_t>(8 * (options.float32 ? sizeof(float) : sizeof(T)));
+      layout.format = options.float32 ? SAMPLEFORMAT_IEEEFP : _SampleFormat<T>();
+      layout.level  = options.level;
+
+      switch (options.compression)
+      {
+      case TiffOptions::Deflate:
+         layout.compression = COMPRESSION_ADOBE_DEFLATE;
+         break;
+      case TiffOptions::ZSTD:
+         layout.compression = COMPRESSION_ZSTD;
+         break;
+      case TiffOptions::LZW:
+         layout.compression = COMPRESSION_LZW;
+         break;
+      default:
+         layout.compression = COMPRESSION_NONE;
+         break;
+      }
+
+      if (!options.predictor)
+         layout.predictor = PREDICTOR_NONE;
+      else if (layout.format == SAMPLEFORMAT_IEEEFP)
+         layout.predictor = PREDICTOR_FLOATINGPOINT;
+      else
+         layout.predictor = PREDICTOR_HORIZONTAL;
+
+      if (!TIFFIsCODECConfigured(layout.compression))
+      {
+         spdlog::error("The TIFF library was built without the requested compression");
+         exit(EXIT_FAILURE);
+      }
+
+      if (layout.tiled)
+      {
+         if (options.tileSize % 16 != 0)
+         {
+            spdlog::error("Tile size must be a multiple of 16, got {}", options.tileSize);
+            exit(EXIT_FAILURE);
+         }
+         layout.bw = options.tileSize;
+         layout.bh = options.tileSize;
+      }
+      else
+      {
+         // Strips of roughly 256 KiB, large enough to compress well and to spread over threads
+         layout.bw = static_cast<uint32_t>(this->nCols);
+         layout.bh = static_cast<uint32_t>(std::clamp<size_t>(
+            (size_t{1} << 18) / std::max<size_t>(1, this->nCols * layout.bps / 8), 1, std::max<size_t>(1, this->nRows)));
+      }
+
       _XTIFFInitialize();
 
       TIFF *tiff = TIFFOpen(path.c_str(), "w");
@@ -280,14 +743,8 @@ namespace KiLib
       }
 
       // TIFF tags
-      TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, this->nCols);
-      TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, this->nRows);
+      _SetLayoutTags(tiff, layout, static_cast<uint32_t>(this->nCols), static_cast<uint32_t>(this->nRows));
       TIFFSetField(tiff, TIFFTAG_SOFTWARE, "KiLib");
-      TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 64);
-      TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 1);
-      TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, 3);
-      TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-      TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
 
       // GeoTIFF tags
       if (kd.size() != (size_t)(4 + kd[3] * 4))
@@ -299,26 +756,28 @@ namespace KiLib
       TIFFSetField(tiff, GEOTIFFTAG_KEYDIRECTORY, kd.size(), kd.data());
       TIFFSetField(tiff, GEOTIFFTAG_MODELPIXELSCALE, 3, mps);
       TIFFSetField(tiff, GEOTIFFTAG_MODELTIEPOINT, 6, mtp);
-      TIFFSetField(tiff, GEOTIFFTAG_NODATAVALUE, fmt::format("{} ", this->nodata_value).c_str());
+      // Nodata as stored in the samples, which is only different when they cannot hold nodata_value
+      const double nodata = options.float32 ? CellConverter<T, float>(this->nodata_value).nodata()
+                                            : CellConverter<T, T>(this->nodata_value).nodata();
+      TIFFSetField(tiff, GEOTIFFTAG_NODATAVALUE, fmt::format("{} ", nodata).c_str());
 
       // Writing data to file
-      uint64_t sls = TIFFScanlineSize64(tiff);
-      tdata_t  buf = _TIFFmalloc((signed int)sls);
+      const bool ok =
+         options.float32 ? _WriteBlocks<float>(tiff, layout, *this) : _WriteBlocks<T>(tiff, layout, *this);
 
-      // There is no use in parallelizing this as the file has to be written in order
-      for (size_t row = 0; row < this->nRows; row++)
+      if (!ok)
       {
-         for (size_t col = 0; col < this->nCols; col++)
-            ((double *)buf)[col] = this->at(this->nRows - row - 1, col);
-
-         if (TIFFWriteScanline(tiff, buf, row) == -1)
-         {
-            spdlog::error("Failed to write data to {}", path);
-            exit(EXIT_FAILURE);
-         }
+         spdlog::error("Failed to write data to {}", path);
+         exit(EXIT_FAILURE);
       }
 
-      _TIFFfree(buf);
       TIFFClose(tiff);
    }
-} // namespace KiLib
\ No newline at end of file
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template void BasicRaster<T>::fromTiff(const std::string &path, const WindowResolver &window);                     \
+   template void BasicRaster<T>::toTiff(const std::string &path, const TiffOptions &options) const;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
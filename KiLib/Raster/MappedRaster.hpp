@@ -0,0 +1,118 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Utils/MappedFile.hpp>
+#include <string>
+
+namespace KiLib
+{
+   /**
+    * @brief Read-only raster backed by a memory mapped native raster file (written by BasicRaster::writeToFile with
+    * the .kir extension). Opening only reads the header, cells are paged in from the file on access and shared by
+    * every process mapping it.
+    *
+    * @tparam T Cell type, must match the type the file was written with
+    */
+   template <class T>
+   class BasicMappedRaster
+   {
+   public:
+      using value_type = T;
+
+      double xllcorner;    // Lower left corner x value in absolute coordinates
+      double yllcorner;    // Lower left corner y value in absolute coordinates
+      double cellsize;     // [m] Distance between values
+      double width;        // [m] Width in X
+      double height;       // [m] Height in Y
+      double nodata_value; // Value associated with no data from DEM
+
+      size_t nCols = 0; // Number of columns (x)
+      size_t nRows = 0; // Number of rows (y)
+      size_t nData = 0; // Total number of datapoints
+
+      /**
+       * @brief Maps the native raster at path. Exits if it is not a native raster of cell type T.
+       *
+       * @param path File to map
+       */
+      explicit BasicMappedRaster(const std::string &path);
+
+      /**
+       * @brief Returns the cells, row 0 (the bottom row) first
+       */
+      const T *data() const
+      {
+         return this->cells;
+      }
+
+      /**
+       * @brief Returns a view of the mapped cells, valid as long as this raster lives
+       */
+      BasicRasterView<const T> view() const
+      {
+         return BasicRasterView<const T>(
+            this->cells, this->nRows, this->nCols, this->nCols, this->xllcorner, this->yllcorner, this->cellsize,
+            this->nodata_value);
+      }
+
+      // Mapped rasters can be passed wherever a read-only view is expected
+      operator BasicRasterView<const T>() const
+      {
+         return this->view();
+      }
+
+      /**
+       * @brief Returns the (row, col) index into the raster. Doesn't do bounds checking.
+       */
+      T operator()(size_t row, size_t col) const
+      {
+         return this->cells[row * this->nCols + col];
+      }
+
+      /**
+       * @brief Returns the flat index into the raster. Doesn't do bounds checking.
+       */
+      T operator()(size_t ind) const
+      {
+         return this->cells[ind];
+      }
+
+      /**
+       * @brief Returns the (row, col) index into the raster. Does bounds checking.
+       */
+      T at(size_t row, size_t col) const;
+
+      /**
+       * @brief Returns the flat index into the raster. Does bounds checking.
+       */
+      T at(size_t ind) const;
+
+   private:
+      MappedFile file;
+      const T   *cells = nullptr;
+   };
+
+   // Double precision mapped raster
+   using MappedRaster = BasicMappedRaster<double>;
+
+} // namespace KiLib
@@ -19,15 +19,35 @@
 
 
 #include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Raster/SummedAreaTable.hpp>
 #include <KiLib/Utils/Distributions.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <filesystem>
+#include <limits>
 #include <spdlog/fmt/ostr.h>
 
 namespace fs = std::filesystem;
 
 namespace KiLib
 {
-   Raster::Raster()
+   // Raster of doubles with the metadata of ref, nodata where ref holds nodata and 0 elsewhere
+   template <class T>
+   static BasicRaster<double> _ZerosLike(const BasicRaster<T> &ref)
+   {
+      BasicRaster<double> out = BasicRaster<double>::fromMetadata(
+         ref.nRows, ref.nCols, ref.xllcorner, ref.yllcorner, ref.cellsize, ref.nodata_value);
+      for (size_t i = 0; i < ref.nData; i++)
+      {
+         if (ref(i) == ref.nodata_value)
+            out(i) = out.nodata_value;
+      }
+      return out;
+   }
+
+   template <class T>
+   BasicRaster<T>::BasicRaster()
    {
       this->nRows = 0;
       this->nCols = 0;
@@ -36,14 +56,57 @@ namespace KiLib
    }
 
    // Load data in Raster format from specified path
-   Raster::Raster(const std::string &path)
+   template <class T>
+   BasicRaster<T>::BasicRaster(const std::string &path)
+   {
+      this->fromFile(path, [](const BasicRaster &) { return RasterWindow(); });
+   }
+
+   template <class T>
+   BasicRaster<T>::BasicRaster(const std::string &path, const RasterWindow &window)
+   {
+      this->fromFile(path, [&](const BasicRaster &) { return window; });
+   }
+
+   template <class T>
+   BasicRaster<T>::BasicRaster(const std::string &path, const KiLib::Vec3 &lowerLeft, const KiLib::Vec3 &upperRight)
+   {
+      auto resolve = [&](const BasicRaster &full)
+      {
+         const double c0 = std::floor((lowerLeft.x - full.xllcorner) / full.cellsize);
+         const double c1 = std::ceil((upperRight.x - full.xllcorner) / full.cellsize);
+         const double r0 = std::floor((lowerLeft.y - full.yllcorner) / full.cellsize);
+         const double r1 = std::ceil((upperRight.y - full.yllcorner) / full.cellsize);
+
+         if (c1 <= std::max(c0, 0.0) || r1 <= std::max(r0, 0.0) || c0 >= full.nCols || r0 >= full.nRows)
+         {
+            throw std::invalid_argument(fmt::format(
+               "Bounds ({}, {}) - ({}, {}) do not overlap the raster", lowerLeft.x, lowerLeft.y, upperRight.x,
+               upperRight.y));
+         }
+
+         RasterWindow window;
+         window.col   = static_cast<size_t>(std::max(c0, 0.0));
+         window.row   = static_cast<size_t>(std::max(r0, 0.0));
+         window.nCols = static_cast<size_t>(std::min<double>(c1, full.nCols)) - window.col;
+         window.nRows = static_cast<size_t>(std::min<double>(r1, full.nRows)) - window.row;
+         return window;
+      };
+
+      this->fromFile(path, resolve);
+   }
+
+   template <class T>
+   void BasicRaster<T>::fromFile(const std::string &path, const WindowResolver &window)
    {
       auto ext = fs::path(path).extension();
 
       if (ext == ".asc" || ext == ".dem")
-         this->fromDEM(path);
+         this->fromDEM(path, window);
       else if (ext == ".tif" || ext == ".tiff")
-         this->fromTiff(path);
+         this->fromTiff(path, window);
+      else if (ext == ".kir")
+         this->fromNative(path, window);
       else
       {
          spdlog::error("Unsupported file type given to raster constructor: {}", ext);
@@ -51,35 +114,76 @@ namespace KiLib
       }
    }
 
-   // Returns (bilinear) interpolated data value at specified position
-   // Takes in a vec3 for convenience, ignores Z
-   double Raster::getInterpBilinear(const Vec3 &pos) const
+   template <class T>
+   BasicRaster<T>::BasicRaster(const BasicRasterView<const T> &view)
    {
-      double x = (pos.x - this->xllcorner) / this->cellsize;
-      double y = (pos.y - this->yllcorner) / this->cellsize;
+      this->xllcorner    = view.xllcorner;
+      this->yllcorner    = view.yllcorner;
+      this->cellsize     = view.cellsize;
+      this->width        = view.width;
+      this->height       = view.height;
+      this->nodata_value = view.nodata_value;
+      this->nCols        = view.nCols;
+      this->nRows        = view.nRows;
+      this->nData        = view.nData;
+      this->data.resize(this->nData);
+
+      for (size_t r = 0; r < this->nRows; r++)
+         std::copy_n(&view(r, 0), this->nCols, &this->data[r * this->nCols]);
+   }
 
-      const size_t r = std::min(static_cast<size_t> (std::floor(y)), this->nRows - 1ul);
-      const size_t c = std::min(static_cast<size_t> (std::floor(x)), this->nCols - 1ul);
-      
+   template <class T>
+   BasicRasterView<T> BasicRaster<T>::view()
+   {
+      return BasicRasterView<T>(
+         this->data.data(), this->nRows, this->nCols, this->nCols, this->xllcorner, this->yllcorner, this->cellsize,
+         this->nodata_value);
+   }
 
-      const size_t ru = std::min(r + 1ul, this->nRows - 1ul);
-      const size_t cr = std::min(c + 1ul, this->nCols - 1ul);
+   template <class T>
+   BasicRasterView<const T> BasicRaster<T>::view() const
+   {
+      return BasicRasterView<const T>(
+         this->data.data(), this->nRows, this->nCols, this->nCols, this->xllcorner, this->yllcorner, this->cellsize,
+         this->nodata_value);
+   }
 
-      const double f00 = this->operator()(r, c);
-      const double f10 = this->operator()(r, cr);
-      const double f01 = this->operator()(ru, c);
-      const double f11 = this->operator()(ru, cr);
+   template <class T>
+   BasicRasterView<T> BasicRaster<T>::view(const RasterWindow &window)
+   {
+      return this->view().subView(window);
+   }
 
-      const double sx = x - std::floor(x);
-      const double sy = y - std::floor(y);
+   template <class T>
+   BasicRasterView<const T> BasicRaster<T>::view(const RasterWindow &window) const
+   {
+      return this->view().subView(window);
+   }
 
-      const double val = f00 * (1.0 - sx) * (1.0 - sy) + f10 * sx * (1.0 - sy) + f01 * (1.0 - sx) * sy + f11 * sx * sy;
+   // Moves the corner and sizes of this raster from the whole file to window
+   template <class T>
+   void BasicRaster<T>::applyWindow(const RasterWindow &window)
+   {
+      this->xllcorner += window.col * this->cellsize;
+      this->yllcorner += window.row * this->cellsize;
+      this->nRows  = window.nRows;
+      this->nCols  = window.nCols;
+      this->nData  = this->nRows * this->nCols;
+      this->width  = this->nCols * this->cellsize;
+      this->height = this->nRows * this->cellsize;
+   }
 
-      return val;
+   // Returns (bilinear) interpolated data value at specified position
+   // Takes in a vec3 for convenience, ignores Z
+   template <class T>
+   double BasicRaster<T>::getInterpBilinear(const Vec3 &pos) const
+   {
+      return this->view().getInterpBilinear(pos);
    }
 
    // Print Raster metadata
-   void Raster::print() const
+   template <class T>
+   void BasicRaster<T>::print() const
    {
       fmt::print(
          "ncols {}\n"
@@ -94,22 +198,27 @@ namespace KiLib
       {
          for (size_t col = 0; col < this->nCols; col++)
          {
-            double val = this->operator()(this->nRows - row, col);
+            T val = this->operator()(this->nRows - row, col);
 
             if (val == this->nodata_value)
             {
                fmt::print("{} ", this->nodata_value);
             }
-            else
+            else if constexpr (std::is_floating_point_v<T>)
             {
                fmt::print("{: .3f} ", val);
             }
+            else
+            {
+               fmt::print("{} ", val);
+            }
          }
          fmt::print("\n");
       }
    }
 
-   void Raster::writeToFile(const std::string &path) const
+   template <class T>
+   void BasicRaster<T>::writeToFile(const std::string &path, const TiffOptions &tiffOptions) const
    {
 
       auto ext = fs::path(path).extension();
@@ -117,7 +226,9 @@ namespace KiLib
       if (ext == ".asc" || ext == ".dem")
          this->toDEM(path);
       else if (ext == ".tif" || ext == ".tiff")
-         this->toTiff(path);
+         this->toTiff(path, tiffOptions);
+      else if (ext == ".kir")
+         this->toNative(path);
       else
       {
          spdlog::error("Unsupported output file type: {}", ext);
@@ -125,7 +236,8 @@ namespace KiLib
       }
    }
 
-   KiLib::Vec3 Raster::randPoint(std::mt19937_64 &gen) const
+   template <class T>
+   KiLib::Vec3 BasicRaster<T>::randPoint(std::mt19937_64 &gen) const
    {
       KiLib::Vec3                            point;
       std::uniform_real_distribution<double> xDist(this->xllcorner, this->xllcorner + this->width);
@@ -138,12 +250,14 @@ namespace KiLib
       return point;
    }
 
-   size_t Raster::flattenIndex(size_t r, size_t c) const
+   template <class T>
+   size_t BasicRaster<T>::flattenIndex(size_t r, size_t c) const
    {
       return r * this->nCols + c;
    }
 
-   size_t Raster::getNearestCell(const KiLib::Vec3 &pos) const
+   template <class T>
+   size_t BasicRaster<T>::getNearestCell(const KiLib::Vec3 &pos) const
    {
       double rF = (pos.y - this->yllcorner) / this->cellsize;
       double cF = (pos.x - this->xllcorner) / this->cellsize;
@@ -156,7 +270,8 @@ namespace KiLib
       return r * this->nCols + c;
    }
 
-   KiLib::Vec3 Raster::getCellPos(size_t ind) const
+   template <class T>
+   KiLib::Vec3 BasicRaster<T>::getCellPos(size_t ind) const
    {
       size_t r = ind / this->nCols;
       size_t c = ind % this->nCols;
@@ -167,7 +282,8 @@ namespace KiLib
       return pos;
    }
 
-   KiLib::Vec3 Raster::getCellCenter(size_t ind) const
+   template <class T>
+   KiLib::Vec3 BasicRaster<T>::getCellCenter(size_t ind) const
    {
       size_t r = ind / this->nCols;
       size_t c = ind % this->nCols;
@@ -180,51 +296,274 @@ namespace KiLib
       return pos;
    }
 
-   double Raster::GetAverage(size_t ind, double radius) const
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::rasterizeMean(
+      const BasicRaster &ref, const std::vector<double> &sums, const std::vector<double> &counts, int width)
    {
-      auto [r, c] = Raster::GetRowCol(ind);
+      BasicRaster<double> out   = _ZerosLike(ref);
+      const long          nRows = static_cast<long>(ref.nRows);
+      const long          nCols = static_cast<long>(ref.nCols);
+      if (width < 0)
+         return out;
 
-      int extent = static_cast<int>(std::floor(radius / this->cellsize));
+      if (width == 0)
+      {
+#pragma omp parallel for schedule(static)
+         for (long i = 0; i < static_cast<long>(ref.nData); i++)
+         {
+            if (out(i) != out.nodata_value && counts[i] != 0)
+               out(i) = sums[i] / counts[i];
+         }
+         return out;
+      }
 
-      int leftB  = std::clamp(c - extent, 0, (int)this->nCols - 1);
-      int rightB = std::clamp(c + extent, 0, (int)this->nCols - 1);
-      int upB    = std::clamp(r + extent, 0, (int)this->nRows - 1);
-      int lowB   = std::clamp(r - extent, 0, (int)this->nRows - 1);
+      // A NaN nodata makes every cell valid, so the tables add up the sums and counts of every cell of a window
+      const double          nan = std::numeric_limits<double>::quiet_NaN();
+      const SummedAreaTable sumTable(BasicRasterView<const double>(
+         sums.data(), ref.nRows, ref.nCols, ref.nCols, ref.xllcorner, ref.yllcorner, ref.cellsize, nan));
+      const SummedAreaTable countTable(BasicRasterView<const double>(
+         counts.data(), ref.nRows, ref.nCols, ref.nCols, ref.xllcorner, ref.yllcorner, ref.cellsize, nan));
 
-      double sum = 0.0;
-      double num = 0.0;
-      for (int ri = lowB; ri <= upB; ri++)
+#pragma omp parallel for schedule(static)
+      for (long r = 0; r < nRows; r++)
       {
-         for (int ci = leftB; ci <= rightB; ci++)
+         const long r0 = std::max(r - width, 0L);
+         const long r1 = std::min(r + width + 1, nRows);
+         for (long c = 0; c < nCols; c++)
          {
-            // Skip nodata
-            if (this->at(ri, ci) == this->nodata_value)
-            {
+            if (out(r, c) == out.nodata_value)
+               continue;
+
+            const long         c0 = std::max(c - width, 0L);
+            const long         c1 = std::min(c + width + 1, nCols);
+            const RasterWindow window{(size_t)r0, (size_t)c0, (size_t)(r1 - r0), (size_t)(c1 - c0)};
+            double             sum = 0, count = 0;
+            size_t             cells = 0;
+            sumTable.GetWindowSum(window, sum, cells);
+            countTable.GetWindowSum(window, count, cells);
+            if (count != 0)
+               out(r, c) = sum / count;
+         }
+      }
+      return out;
+   }
+
+   template <class T>
+   typename BasicRaster<T>::RasterizedStatistics BasicRaster<T>::rasterizeStatistics(
+      const BasicRaster &ref, const std::vector<size_t> &inds, const std::vector<double> &values, unsigned statistics,
+      const std::vector<double> &quantiles)
+   {
+      for (double p : quantiles)
+      {
+         if (!(p >= 0 && p <= 1))
+            throw std::invalid_argument("Quantiles must be probabilities in [0, 1]");
+      }
+
+      RasterizedStatistics                 result;
+      std::array<BasicRaster<double> *, 6> rasters{&result.mean, &result.sum,   &result.max,
+                                                   &result.min,  &result.count, &result.variance};
+      std::array<double *, 6>              outs{};
+      for (size_t k = 0; k < rasters.size(); k++)
+      {
+         if (statistics & (1u << k))
+         {
+            *rasters[k] = _ZerosLike(ref);
+            outs[k]     = rasters[k]->data.data();
+         }
+      }
+      std::vector<double *> quantileOuts(quantiles.size());
+      result.quantiles.resize(quantiles.size());
+      for (size_t q = 0; q < quantiles.size(); q++)
+      {
+         result.quantiles[q] = _ZerosLike(ref);
+         quantileOuts[q]     = result.quantiles[q].data.data();
+      }
+
+      // Attributes grouped by cell, in the order of the objects, with a counting sort
+      const size_t        N = ref.nData;
+      std::vector<size_t> start(N + 1, 0);
+      for (size_t ind : inds)
+         start[ind + 1]++;
+      for (size_t k = 0; k < N; k++)
+         start[k + 1] += start[k];
+      std::vector<double> grouped(values.size());
+      {
+         std::vector<size_t> next(start.begin(), start.end() - 1);
+         for (size_t i = 0; i < inds.size(); i++)
+            grouped[next[inds[i]]++] = values[i];
+      }
+
+      const double nodata = ref.nodata_value;
+#pragma omp parallel
+      {
+         // Attributes of the current cell, partially sorted to find quantiles
+         std::vector<double> scratch;
+
+#pragma omp for schedule(dynamic, 1024)
+         for (long k = 0; k < static_cast<long>(N); k++)
+         {
+            if (ref(k) == ref.nodata_value)
                continue;
+
+            const double *v   = grouped.data() + start[k];
+            const size_t  n   = start[k + 1] - start[k];
+            double        sum = 0;
+            double        max = -std::numeric_limits<double>::infinity();
+            double        min = std::numeric_limits<double>::infinity();
+            for (size_t j = 0; j < n; j++)
+            {
+               sum += v[j];
+               max = v[j] > max ? v[j] : max;
+               min = v[j] < min ? v[j] : min;
             }
-            // This can probably be done faster, handles the corners being out of the radius
-            const double dr   = std::abs((double)(r - ri)) * cellsize;
-            const double dc   = std::abs((double)(c - ci)) * cellsize;
-            const double dist = sqrt(dr * dr + dc * dc);
-            if (dist > radius)
+
+            if (outs[0])
+               outs[0][k] = n ? sum / n : 0;
+            if (outs[1])
+               outs[1][k] = sum;
+            if (outs[2])
+               outs[2][k] = n ? max : nodata;
+            if (outs[3])
+               outs[3][k] = n ? min : nodata;
+            if (outs[4])
+               outs[4][k] = static_cast<double>(n);
+            if (outs[5])
             {
-               SPDLOG_DEBUG("SKIPPING\n");
+               // Welford's update, which does not cancel catastrophically when the mean is large
+               double mean = 0, m2 = 0;
+               for (size_t j = 0; j < n; j++)
+               {
+                  const double delta = v[j] - mean;
+                  mean += delta / static_cast<double>(j + 1);
+                  m2 += delta * (v[j] - mean);
+               }
+               outs[5][k] = n ? m2 / n : nodata;
+            }
+
+            if (quantiles.empty())
                continue;
+            scratch.assign(v, v + n);
+            for (size_t q = 0; q < quantiles.size(); q++)
+            {
+               if (n == 0)
+               {
+                  quantileOuts[q][k] = nodata;
+                  continue;
+               }
+
+               // Linear interpolation between the closest ranks, the default of R and numpy
+               const double pos = quantiles[q] * static_cast<double>(n - 1);
+               const size_t lo  = static_cast<size_t>(pos);
+               std::nth_element(scratch.begin(), scratch.begin() + lo, scratch.end());
+               double value = scratch[lo];
+               if (lo + 1 < n)
+               {
+                  const double next = *std::min_element(scratch.begin() + lo + 1, scratch.end());
+                  value += (pos - static_cast<double>(lo)) * (next - value);
+               }
+               quantileOuts[q][k] = value;
             }
-            sum += this->at(ri, ci);
-            num += 1;
          }
       }
-     
-      if (num == 0)
+      return result;
+   }
+
+   template <class T>
+   double BasicRaster<T>::GetAverage(size_t ind, double radius) const
+   {
+      return this->view().GetAverage(ind, radius);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeAverage(double radius) const
+   {
+      return ComputeAverage(this->view(), radius);
+   }
+
+   template <class T>
+   BasicRaster<double> BasicRaster<T>::ComputeAverage(const BasicRasterView<const T> &inp, double radius)
+   {
+      const long   nRows  = static_cast<long>(inp.nRows);
+      const long   nCols  = static_cast<long>(inp.nCols);
+      const double nodata = inp.nodata_value;
+
+      // Row dr of the disk spans columns -half[dr] to half[dr], the cells GetAverage averages
+      const std::vector<long> half  = DiskHalfWidths(radius, inp.cellsize);
+      const long              reach = static_cast<long>(half.size()) - 1;
+      const long              nRing = 2 * reach + 1;
+
+      BasicRaster<double> out = BasicRaster<double>::fromMetadata(
+         inp.nRows, inp.nCols, inp.xllcorner, inp.yllcorner, inp.cellsize, nodata);
+
+#pragma omp parallel
       {
-         num += 1;
+         // Running sums and counts of the valid cells of the rows the disk covers, nCols + 1 per row. Threads take
+         // consecutive rows, so most rows are reused from the previous output row.
+         std::vector<double>   sums(std::max(nRing, 0L) * (nCols + 1));
+         std::vector<uint32_t> counts(sums.size());
+         std::vector<long>     held(std::max(nRing, 0L), -1);
+         std::vector<double>   sum(nCols);
+         std::vector<uint32_t> count(nCols);
+
+#pragma omp for schedule(static)
+         for (long r = 0; r < nRows; r++)
+         {
+            std::fill(sum.begin(), sum.end(), 0.0);
+            std::fill(count.begin(), count.end(), 0);
+
+            for (long dr = -reach; dr <= reach; dr++)
+            {
+               const long rr = r + dr;
+               if (rr < 0 || rr >= nRows)
+                  continue;
+
+               const long slot = rr % nRing;
+               double    *S    = sums.data() + slot * (nCols + 1);
+               uint32_t  *C    = counts.data() + slot * (nCols + 1);
+               if (held[slot] != rr)
+               {
+                  held[slot] = rr;
+                  for (long c = 0; c < nCols; c++)
+                  {
+                     const bool valid = inp(rr, c) != nodata;
+                     S[c + 1]         = S[c] + (valid ? inp(rr, c) : 0);
+                     C[c + 1]         = C[c] + valid;
+                  }
+               }
+
+               // Runs clipped by the left and right edges, then the others
+               const long h     = half[std::abs(dr)];
+               const long left  = std::min(h, nCols);
+               const long right = std::max(nCols - h, left);
+               auto       clip  = [&](long c)
+               {
+                  const long lo = std::max(c - h, 0L);
+                  const long hi = std::min(c + h + 1, nCols);
+                  sum[c] += S[hi] - S[lo];
+                  count[c] += C[hi] - C[lo];
+               };
+               for (long c = 0; c < left; c++)
+                  clip(c);
+#pragma omp simd
+               for (long c = left; c < right; c++)
+               {
+                  sum[c] += S[c + h + 1] - S[c - h];
+                  count[c] += C[c + h + 1] - C[c - h];
+               }
+               for (long c = right; c < nCols; c++)
+                  clip(c);
+            }
+
+            for (long c = 0; c < nCols; c++)
+               out(r, c) = inp(r, c) == nodata ? nodata : count[c] == 0 ? 0 : sum[c] / count[c];
+         }
       }
 
-      return sum / num;
+      return out;
    }
 
-   double Raster::distFromBoundary(const Vec3 &pos) const
+   template <class T>
+   double BasicRaster<T>::distFromBoundary(const Vec3 &pos) const
    {
       const double left   = pos.x - this->xllcorner;
       const double right  = this->xllcorner + this->width - pos.x;
@@ -234,7 +573,8 @@ namespace KiLib
       return std::min(std::min(left, right), std::min(top, bottom));
    }
 
-   std::pair<int, int> Raster::GetRowCol(const size_t ind) const
+   template <class T>
+   std::pair<int, int> BasicRaster<T>::GetRowCol(const size_t ind) const
    {
       if (ind >= this->nData)
       {
@@ -246,96 +586,166 @@ namespace KiLib
       return std::make_pair(r, c);
    }
 
-   double Raster::operator()(const Vec3 &pos) const
+   template <class T>
+   double BasicRaster<T>::operator()(const Vec3 &pos) const
    {
       return this->getInterpBilinear(pos);
    }
 
-   double &Raster::at(size_t row, size_t col)
+   template <class T>
+   void BasicRaster<T>::getInterpBilinear(
+      std::span<const double> x, std::span<const double> y, std::span<double> z, bool skipNoData) const
+   {
+      this->view().getInterpBilinear(x, y, z, skipNoData);
+   }
+
+   template <class T>
+   T &BasicRaster<T>::at(size_t row, size_t col)
    {
       return this->data.at(row * this->nCols + col);
    }
 
-   double Raster::at(size_t row, size_t col) const
+   template <class T>
+   T BasicRaster<T>::at(size_t row, size_t col) const
    {
       return this->data.at(row * this->nCols + col);
    }
 
-   double &Raster::operator()(size_t row, size_t col)
+   template <class T>
+   T &BasicRaster<T>::operator()(size_t row, size_t col)
    {
       return this->data[row * this->nCols + col];
    }
 
-   double Raster::operator()(size_t row, size_t col) const
+   template <class T>
+   T BasicRaster<T>::operator()(size_t row, size_t col) const
    {
       return this->data[row * this->nCols + col];
    }
 
-   double Raster::operator()(size_t ind) const
+   template <class T>
+   T BasicRaster<T>::operator()(size_t ind) const
    {
       return this->data[ind];
    }
 
-   double &Raster::operator()(size_t ind)
+   template <class T>
+   T &BasicRaster<T>::operator()(size_t ind)
    {
       return this->data[ind];
    }
 
-   double &Raster::at(size_t ind)
+   template <class T>
+   T &BasicRaster<T>::at(size_t ind)
    {
       return this->data.at(ind);
    }
 
-   double Raster::at(size_t ind) const
+   template <class T>
+   T BasicRaster<T>::at(size_t ind) const
    {
       return this->data.at(ind);
    }
 
 
-   KiLib::Raster Raster::fillLike(const KiLib::Raster &other, double fillValue, bool keepNoData)
+   template <class T>
+   BasicRaster<T> BasicRaster<T>::fillLike(const BasicRasterView<const T> &other, T fillValue, bool keepNoData)
    {
-      KiLib::Raster new_(other);
-      for (double &val : new_.data)
-      {
-         if (keepNoData and (val == new_.nodata_value))
-         {
-            continue;
-         }
-         val = fillValue;
-      }
+      BasicRaster new_;
+      new_.assignLike(other, fillValue, keepNoData);
       return new_;
    }
 
-   std::vector<size_t> Raster::getValidIndices(const std::vector<const KiLib::Raster *> &rasts)
+   template <class T>
+   BasicRaster<T> BasicRaster<T>::emptyLike(const BasicRasterView<const T> &other)
    {
-      Raster::assertAgreeDim(rasts);
-      std::vector<size_t> inds;
+      BasicRaster new_;
+      new_.resizeLike(other);
+      return new_;
+   }
 
-      for (size_t i = 0; i < rasts[0]->data.size(); i++)
-      {
-         bool foundBad = false;
+   template <class T>
+   BasicRaster<T> BasicRaster<T>::fromMetadata(
+      size_t nRows, size_t nCols, double xllcorner, double yllcorner, double cellsize, double nodata_value, T fillValue)
+   {
+      BasicRaster new_;
+      new_.xllcorner    = xllcorner;
+      new_.yllcorner    = yllcorner;
+      new_.cellsize     = cellsize;
+      new_.width        = nCols * cellsize;
+      new_.height       = nRows * cellsize;
+      new_.nodata_value = nodata_value;
+      new_.nCols        = nCols;
+      new_.nRows        = nRows;
+      new_.nData        = nRows * nCols;
+      new_.data.assign(new_.nData, fillValue);
+      return new_;
+   }
 
-         // Check all rasters at index i for nodata
-         for (const KiLib::Raster *rast : rasts)
+   template <class T>
+   void BasicRaster<T>::resizeLike(const BasicRasterView<const T> &other)
+   {
+      this->xllcorner    = other.xllcorner;
+      this->yllcorner    = other.yllcorner;
+      this->cellsize     = other.cellsize;
+      this->width        = other.width;
+      this->height       = other.height;
+      this->nodata_value = other.nodata_value;
+      this->nCols        = other.nCols;
+      this->nRows        = other.nRows;
+      this->nData        = other.nData;
+      this->data.resize(this->nData);
+   }
+
+   template <class T>
+   void BasicRaster<T>::assignLike(const BasicRasterView<const T> &other, T fillValue, bool keepNoData)
+   {
+      // Read before resizing, other may view this raster
+      const T     *src    = other.data();
+      const double nodata = other.nodata_value;
+
+      this->resizeLike(other);
+
+      // One pass writing every cell, the nodata mask is applied as the fill is written
+      const long nRowsL = static_cast<long>(this->nRows);
+#pragma omp parallel for schedule(static) if (this->nData > (1 << 16))
+      for (long r = 0; r < nRowsL; r++)
+      {
+         const T *in  = src + r * other.stride;
+         T       *out = &this->data[r * this->nCols];
+         if (keepNoData)
          {
-            if (rast->operator()(i) == rast->nodata_value)
-            {
-               foundBad = true;
-               break;
-            }
+            for (size_t c = 0; c < this->nCols; c++)
+               out[c] = (in[c] == nodata) ? in[c] : fillValue;
          }
-
-         // If found none, append i
-         if (foundBad == false)
+         else
          {
-            inds.push_back(i);
+            std::fill_n(out, this->nCols, fillValue);
          }
       }
+   }
+
+   template <class T>
+   ValidityMask BasicRaster<T>::getValidMask(const std::vector<const BasicRaster *> &rasts)
+   {
+      BasicRaster::assertAgreeDim(rasts);
+      if (rasts.empty())
+         return ValidityMask();
+
+      ValidityMask mask(rasts[0]->view());
+      for (size_t i = 1; i < rasts.size(); i++)
+         mask &= ValidityMask(rasts[i]->view());
+      return mask;
+   }
 
-      return inds;
+   template <class T>
+   std::vector<size_t> BasicRaster<T>::getValidIndices(const std::vector<const BasicRaster *> &rasts)
+   {
+      return BasicRaster::getValidMask(rasts).indices();
    }
 
-   void Raster::assertAgreeDim(const std::vector<const KiLib::Raster *> &rasts)
+   template <class T>
+   void BasicRaster<T>::assertAgreeDim(const std::vector<const BasicRaster *> &rasts)
    {
       if (rasts.size() == 0)
       {
@@ -351,30 +761,31 @@ namespace KiLib
       };
 
       // Cell Size
-      for (const KiLib::Raster *rast : rasts)
+      for (const BasicRaster *rast : rasts)
       {
          cmp(rast->cellsize, rasts.at(0)->cellsize, 1e-2, "CellSize");
       }
 
       // nRows
-      for (const KiLib::Raster *rast : rasts)
+      for (const BasicRaster *rast : rasts)
       {
          cmp(static_cast<double>(rast->nRows), static_cast<double>(rasts.at(0)->nRows), 0.0, "Num Rows");
       }
 
       // nCols
-      for (const KiLib::Raster *rast : rasts)
+      for (const BasicRaster *rast : rasts)
       {
          cmp(static_cast<double>(rast->nCols), static_cast<double>(rasts.at(0)->nCols), 0.0, "Num Cols");
       }
    }
 
-   std::optional<KiLib::Vec3> Raster::GetCoordMinDistance(
+   template <class T>
+   std::optional<KiLib::Vec3> BasicRaster<T>::GetCoordMinDistance(
       //size_t ind, double zInd, const KiLib::Raster &elev, double radius, double threshold) const
-      size_t ind, const KiLib::Vec3 &inPos, const KiLib::Raster &elev, double radius, double threshold) const
+      size_t ind, const KiLib::Vec3 &inPos, const BasicRaster &elev, double radius, double threshold) const
    {
       const auto zInd = inPos.z;
-      auto [r, c] = Raster::GetRowCol(ind);
+      auto [r, c] = this->GetRowCol(ind);
 
       const int extent = static_cast<int>(std::floor(radius / this->cellsize));
 
@@ -448,11 +859,12 @@ namespace KiLib
       }
    }
 
-   std::optional<KiLib::Vec3> Raster::FindClosestStreamCell(size_t ind, const KiLib::Vec3 &inPos, const KiLib::Raster &elev, double radius, double threshold, double shape, double runoutAngle, double &runoutProb) const
+   template <class T>
+   std::optional<KiLib::Vec3> BasicRaster<T>::FindClosestStreamCell(size_t ind, const KiLib::Vec3 &inPos, const BasicRaster &elev, double radius, double threshold, double shape, double runoutAngle, double &runoutProb) const
    {
       const auto zInd = inPos.z;
 
-      auto [r, c] = Raster::GetRowCol(ind);
+      auto [r, c] = this->GetRowCol(ind);
 
       const int extent = static_cast<int>(std::floor(radius / this->cellsize));
 
@@ -512,4 +924,8 @@ namespace KiLib
       }
    }
 
+#define KILIB_RASTER_INSTANTIATE(T) template class BasicRaster<T>;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
 } // namespace KiLib
@@ -20,25 +20,70 @@
 
 #pragma once
 
+#include <KiLib/Raster/CellConverter.hpp>
+#include <KiLib/Raster/RasterView.hpp>
+#include <KiLib/Raster/ValidityMask.hpp>
 #include <KiLib/Utils/Vec3.hpp>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <optional>
 #include <random>
 #include <string>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Cell types BasicRaster is explicitly instantiated for in the library. Each translation unit that defines
+// BasicRaster members instantiates them through this list.
+#define KILIB_RASTER_FOREACH_TYPE(MACRO)                                                                               \
+   MACRO(double)                                                                                                       \
+   MACRO(float)                                                                                                        \
+   MACRO(int32_t)                                                                                                      \
+   MACRO(int16_t)                                                                                                      \
+   MACRO(uint16_t)                                                                                                     \
+   MACRO(uint8_t)
+
 namespace KiLib
 {
 
+   /**
+    * @brief Options used when writing a raster to a GeoTIFF. The defaults write an uncompressed, striped file in the
+    * raster's cell type.
+    */
+   struct TiffOptions
+   {
+      enum Compression
+      {
+         None,
+         Deflate,
+         ZSTD,
+         LZW,
+      };
+
+      Compression compression = None;
+      int         level       = 0;     // Codec compression level, 0 keeps the codec default
+      bool        predictor   = true;  // Floating point (horizontal for integers) predictor, only used when compressing
+      bool        float32     = false; // Store samples as 32-bit floats regardless of the cell type
+      uint32_t    tileSize    = 0;     // Tile width and length in pixels, must be a multiple of 16. 0 writes strips
+   };
+
    /**
     * @brief Loads in Rasters (like DEMs) and provides nice helper functions such
     * as interpolation, matrix-like access, and so on.
     *
+    * @tparam T Cell storage type. Metadata (corners, cellsize, nodata) is always stored as double, interpolation and
+    * averages are computed in double.
     */
-   class Raster
+   template <class T>
+   class BasicRaster
    {
    public:
-      std::vector<double> data;
+      using value_type = T;
+
+      std::vector<T> data;
 
       double xllcorner;    // Lower left corner x value in absolute coordinates
       double yllcorner;    // Lower left corner y value in absolute coordinates
@@ -51,15 +96,129 @@ namespace KiLib
       size_t nRows = 0; // Number of rows (y)
       size_t nData = 0; // Total number of datapoints
 
-      Raster(const std::string &path);
-      Raster();
+      BasicRaster(const std::string &path);
+      BasicRaster();
+
+      /**
+       * @brief Loads only a window of the raster at path. TIFF files only decode the strips or tiles overlapping the
+       * window, ASCII files skip the rows outside it without parsing them. The corners and sizes describe the window.
+       *
+       * @param path File to load
+       * @param window Rows and columns to load
+       */
+      BasicRaster(const std::string &path, const RasterWindow &window);
+
+      /**
+       * @brief Loads the smallest window of the raster at path covering the box between lowerLeft and upperRight
+       * (Z is ignored)
+       *
+       * @param path File to load
+       * @param lowerLeft Minimum x and y of the box in absolute coordinates
+       * @param upperRight Maximum x and y of the box in absolute coordinates
+       */
+      BasicRaster(const std::string &path, const KiLib::Vec3 &lowerLeft, const KiLib::Vec3 &upperRight);
+
+      /**
+       * @brief Converts a raster of another cell type, copying metadata and converting every value with
+       * CellConverter: nodata cells stay nodata (nodata_value is replaced if T cannot hold it) and other values
+       * saturate to the range of T
+       *
+       * @param other Raster to convert
+       */
+      template <class U>
+      explicit BasicRaster(const BasicRaster<U> &other)
+      {
+         const CellConverter<U, T> convert(other.nodata_value);
+
+         this->xllcorner    = other.xllcorner;
+         this->yllcorner    = other.yllcorner;
+         this->cellsize     = other.cellsize;
+         this->width        = other.width;
+         this->height       = other.height;
+         this->nodata_value = convert.nodata();
+         this->nCols        = other.nCols;
+         this->nRows        = other.nRows;
+         this->nData        = other.nData;
+         this->data.resize(other.data.size());
+         convert(other.data.data(), this->data.data(), other.data.size());
+      }
+
+      /**
+       * @brief Copies the cells and metadata of a view into a new raster
+       *
+       * @param view Cells to copy
+       */
+      explicit BasicRaster(const BasicRasterView<const T> &view);
+
+      /**
+       * @brief Returns a view of all cells of this raster. It is invalidated when data is reallocated.
+       */
+      BasicRasterView<T>       view();
+      BasicRasterView<const T> view() const;
+
+      /**
+       * @brief Returns a view of a window of this raster, without copying it
+       *
+       * @param window Rows and columns to view, clipped to the raster
+       */
+      BasicRasterView<T>       view(const RasterWindow &window);
+      BasicRasterView<const T> view(const RasterWindow &window) const;
+
+      // Rasters can be passed wherever a read-only view is expected
+      operator BasicRasterView<const T>() const
+      {
+         return this->view();
+      }
 
       // Creates a raster with same metadata as other, filled with fillValue.
       // If keepNoData is true, returned raster will have nodata in same locations as other.
       // Otherwise every value will be fillValue
-      static KiLib::Raster fillLike(const KiLib::Raster &other, double fillValue, bool keepNoData);
+      static BasicRaster fillLike(const BasicRasterView<const T> &other, T fillValue, bool keepNoData);
 
-      void writeToFile(const std::string &path) const;
+      // Creates a raster with same metadata as other without reading its cells. Cells are value-initialized and meant
+      // to be overwritten.
+      static BasicRaster emptyLike(const BasicRasterView<const T> &other);
+
+      /**
+       * @brief Creates a raster from its metadata, every cell holding fillValue
+       *
+       * @param nRows Number of rows (y)
+       * @param nCols Number of columns (x)
+       * @param xllcorner Lower left corner x value in absolute coordinates
+       * @param yllcorner Lower left corner y value in absolute coordinates
+       * @param cellsize Distance between values
+       * @param nodata_value Value associated with no data
+       * @param fillValue Value of every cell
+       */
+      static BasicRaster fromMetadata(
+         size_t nRows, size_t nCols, double xllcorner, double yllcorner, double cellsize, double nodata_value,
+         T fillValue = T());
+
+      /**
+       * @brief Gives this raster the metadata and size of other, reusing the storage when it is large enough. Cells
+       * are left as they were (new ones are value-initialized) and meant to be overwritten.
+       *
+       * @param other Raster or view to copy metadata from
+       */
+      void resizeLike(const BasicRasterView<const T> &other);
+
+      /**
+       * @brief Same as fillLike, but writes into this raster, reusing its storage when it is large enough. other may be
+       * a view of the whole of this raster, but not of a window of it.
+       *
+       * @param other Raster or view to copy metadata and nodata from
+       * @param fillValue Value of every other cell
+       * @param keepNoData Whether cells that are nodata in other stay nodata
+       */
+      void assignLike(const BasicRasterView<const T> &other, T fillValue, bool keepNoData);
+
+      /**
+       * @brief Writes the raster, picking the format from the extension of path
+       *
+       * @param path Output file (.asc, .dem, .tif, .tiff or .kir for the native format, see BasicMappedRaster)
+       * @param tiffOptions Compression and layout of GeoTIFF output, ignored for other formats
+       */
+      void writeToFile(const std::string &path, const TiffOptions &tiffOptions = TiffOptions()) const;
 
       /**
        * @brief Prints basic information about this Raster
@@ -105,6 +264,13 @@ namespace KiLib
        */
       double operator()(const Vec3 &pos) const;
 
+      /**
+       * @brief Interpolates the values at many positions given as separate x and y arrays, see
+       * BasicRasterView::getInterpBilinear
+       */
+      void getInterpBilinear(
+         std::span<const double> x, std::span<const double> y, std::span<double> z, bool skipNoData = false) const;
+
       /**
        * @brief Returns a REFERENCE to the (row, col) index into the Raster
        *        Does bounds checking.
@@ -113,7 +279,7 @@ namespace KiLib
        * @param col X value
        * @return double& Reference to raster value at position
        */
-      double &at(size_t row, size_t col);
+      T &at(size_t row, size_t col);
 
       /**
        * @brief Returns the (row, col) index into the DEM. Does bounds checking
@@ -122,7 +288,7 @@ namespace KiLib
        * @param col X value
        * @return double Value at position
        */
-      double at(size_t row, size_t col) const;
+      T at(size_t row, size_t col) const;
 
       /**
        * @brief Returns a REFERENCE to the (row, col) index into the Raster
@@ -132,7 +298,7 @@ namespace KiLib
        * @param col X value
        * @return double& Reference to raster value at position
        */
-      double &operator()(size_t row, size_t col);
+      T &operator()(size_t row, size_t col);
 
       /**
        * @brief Returns the (row, col) index into the DEM. Doesn't do bounds checking.
@@ -141,7 +307,7 @@ namespace KiLib
        * @param col X value
        * @return double Value at position
        */
-      double operator()(size_t row, size_t col) const;
+      T operator()(size_t row, size_t col) const;
 
       /**
        * @brief Returns the flat index into the DEM. Doesn't do bounds checking.
@@ -149,7 +315,7 @@ namespace KiLib
        * @param ind Flat index
        * @return double Value at position
        */
-      double operator()(size_t ind) const;
+      T operator()(size_t ind) const;
 
       /**
        * @brief Returns a REFERENCE to the flat index into the DEM. Doesn't do bounds checking.
@@ -157,7 +323,7 @@ namespace KiLib
        * @param ind Flat index
        * @return double Value at position
        */
-      double &operator()(size_t ind);
+      T &operator()(size_t ind);
 
       /**
        * @brief Returns a REFERENCE to the flat index into the DEM. Does bounds checking.
@@ -165,7 +331,7 @@ namespace KiLib
        * @param ind Flat index
        * @return double Value at position
        */
-      double &at(size_t ind);
+      T &at(size_t ind);
 
       /**
        * @brief Returns the flat index into the DEM. Does bounds checking.
@@ -173,104 +339,244 @@ namespace KiLib
        * @param ind Flat index
        * @return double Value at position
        */
-      double at(size_t ind) const;
+      T at(size_t ind) const;
 
-      // Slope methods
+      // Slope methods. Slopes are rise over run (tangent of the slope angle), stored as doubles whatever the cell type
+      // of the elevations.
       enum SlopeMethod
       {
-         ZevenbergenThorne,
+         ZevenbergenThorne, // Central differences of the 4 adjacent cells, one sided next to missing cells
+         Horn,              // Horn (1981) 3x3 finite differences, as ArcGIS and GDAL
+         EvansYoung,        // Evans (1979) / Young (1978) 3x3 least squares quadratic fit
+         MaxDownhill,       // Steepest drop to any of the 8 neighbours, 0 in pits and flats
+      };
+
+      BasicRaster<double>        ComputeSlope(SlopeMethod method) const;
+      static BasicRaster<double> ComputeSlope(const BasicRasterView<const T> &inp, SlopeMethod method);
+      static BasicRaster<double> ComputeSlopeZevenbergenThorne(const BasicRasterView<const T> &inp);
+
+      // 3x3 methods replace neighbours outside of the raster or holding nodata by the centre cell, like GDAL's
+      // compute_edges option. MaxDownhill ignores them instead.
+      static BasicRaster<double> ComputeSlopeHorn(const BasicRasterView<const T> &inp);
+      static BasicRaster<double> ComputeSlopeEvansYoung(const BasicRasterView<const T> &inp);
+      static BasicRaster<double> ComputeSlopeMaxDownhill(const BasicRasterView<const T> &inp);
+
+      // Terrain derivatives of the Zevenbergen and Thorne (1987) surface, combined with | to select several at once.
+      // Curvatures are in 1/m with the signs of Zevenbergen and Thorne (ArcGIS curvatures are 100 times larger).
+      enum TerrainDerivative : unsigned
+      {
+         Slope            = 1 << 0, // Rise over run, as ComputeSlopeZevenbergenThorne
+         Aspect           = 1 << 1, // [deg] Downslope direction clockwise from north (+y), -1 on flats
+         ProfileCurvature = 1 << 2, // Curvature along the slope
+         PlanCurvature    = 1 << 3, // Curvature across the slope
+         TotalCurvature   = 1 << 4, // -2 (D + E), ArcGIS "curvature"
       };
 
-      KiLib::Raster        ComputeSlope(KiLib::Raster::SlopeMethod method) const;
-      static KiLib::Raster ComputeSlopeZevenbergenThorne(const KiLib::Raster &inp);
+      // Outputs of ComputeTerrainDerivatives, defined after BasicRaster
+      struct TerrainDerivatives;
+
+      /**
+       * @brief Computes several terrain derivatives in a single pass over the raster. Missing neighbours are handled
+       * like ComputeSlopeZevenbergenThorne for slope and aspect, and replaced by the centre cell for curvatures.
+       *
+       * @param inp Elevation raster
+       * @param derivatives TerrainDerivative values to compute, combined with |
+       * @return TerrainDerivatives Requested derivatives
+       */
+      static TerrainDerivatives ComputeTerrainDerivatives(const BasicRasterView<const T> &inp, unsigned derivatives);
+      TerrainDerivatives        ComputeTerrainDerivatives(unsigned derivatives) const;
 
       /**
        * @brief Takes in a vector of objects, and takes the mean of a given attribute at each cell position in a raster.
        * The attributes and corresponding positions are mapped to the nearest cell in the raster, and the mean is taken
-       * over cells.
+       * over cells. Cells that are nodata in ref stay nodata, cells without objects in their window are 0. Means are
+       * doubles whatever the cell type of ref.
        *
-       * @tparam T obj
+       * @tparam O obj
        * @param ref Reference raster to determine shape, size, nodata, etc
        * @param objs vector of objects
-       * @param posP Pointer to position attribute (i.e. &Landslide::pos)
-       * @param attrP Pointer to attribute to rasterize (i.e. &Landslide::safetyFactor)
-       * @param doPopulate function that dictates whether or not that instace will be rasterized
-       * @param width Number of cells to average over. 0 is just cell at i,j; 1 is 9x9 region around i,j; and so on.
-       * @return KiLib::Raster
+       * @param getPos Callable or pointer to member giving the position of an object (i.e. &Landslide::pos)
+       * @param getAttr Callable or pointer to member giving the attribute to rasterize (i.e. &Landslide::safetyFactor)
+       * @param width Number of cells to average over. 0 is just cell at i,j; 1 is 3x3 region around i,j; and so on.
+       * @return BasicRaster<double>
        *
        */
-      template <class T>
-      static KiLib::Raster Rasterize(
-         const KiLib::Raster &ref, const std::vector<T> &objs, std::function<KiLib::Vec3(T)> getPos,
-         std::function<double(T)> getAttr, int width = 0)
+      template <class O, class GetPos, class GetAttr>
+      static BasicRaster<double>
+         Rasterize(const BasicRaster &ref, const std::vector<O> &objs, GetPos getPos, GetAttr getAttr, int width = 0)
       {
-         KiLib::Raster sumRast = KiLib::Raster::fillLike(ref, 0.0, true);
-         KiLib::Raster outRast = KiLib::Raster::fillLike(ref, 0.0, true);
-
-         std::unordered_map<size_t, double> counts;
+         // Sum of the attributes and number of objects of every cell
+         std::vector<double> sums(ref.nData, 0.0);
+         std::vector<double> counts(ref.nData, 0.0);
 
-         for (auto &obj : objs)
+         auto scatter = [&](size_t begin, size_t end, double *sum, double *count)
          {
-            KiLib::Vec3 pos  = getPos(obj);
-            double      attr = getAttr(obj);
-
-            size_t flatInd  = sumRast.getNearestCell(pos);
-            counts[flatInd] = counts.count(flatInd) == 0 ? 1.0 : counts[flatInd] + 1;
-
-            sumRast(flatInd) += attr;
-         }
+            for (size_t i = begin; i < end; i++)
+            {
+               const size_t ind = ref.getNearestCell(std::invoke(getPos, objs[i]));
+               sum[ind] += static_cast<double>(std::invoke(getAttr, objs[i]));
+               count[ind] += 1;
+            }
+         };
 
-         for (int r = 0; r < (int)sumRast.nRows; r++)
+#ifdef _OPENMP
+         // Threads scatter into buffers of their own, added up once every object is placed. Buffers cost as much as
+         // the raster per thread, so they are only used when there are more objects than cells.
+         const size_t nThreads = static_cast<size_t>(omp_get_max_threads());
+         if (nThreads > 1 && objs.size() >= std::max<size_t>(ref.nData, 1 << 16))
          {
-            for (int c = 0; c < (int)sumRast.nCols; c++)
+            std::vector<std::vector<double>> local(nThreads);
+            const long                       n = static_cast<long>(objs.size());
+            const long                       N = static_cast<long>(ref.nData);
+#pragma omp parallel num_threads(nThreads)
             {
-               // Skip nodata
-               if (sumRast.at((size_t)r,(size_t) c) == sumRast.nodata_value)
-               {
-                  continue;
-               }
-               double count = 0.0;
-               double sum   = 0.0;
-               for (int ri = r - width; ri <= (r + width); ri++)
+               const size_t t       = static_cast<size_t>(omp_get_thread_num());
+               const size_t threads = static_cast<size_t>(omp_get_num_threads());
+               if (t > 0)
+                  local[t].assign(2 * ref.nData, 0.0);
+               double *sum   = t > 0 ? local[t].data() : sums.data();
+               double *count = t > 0 ? local[t].data() + ref.nData : counts.data();
+               scatter(n * t / threads, n * (t + 1) / threads, sum, count);
+#pragma omp barrier
+
+#pragma omp for schedule(static)
+               for (long k = 0; k < N; k++)
                {
-                  for (int ci = c - width; ci <= (c + width); ci++)
+                  for (size_t u = 1; u < threads; u++)
                   {
-                     // Dont sum out of bounds, cant sum where we have no points
-                     if (
-                        counts.count(sumRast.flattenIndex((size_t)ri, (size_t)ci)) == 0 or ri < 0 or ri >= (int)sumRast.nRows or
-                        ci < 0 or ci >= (int)sumRast.nCols)
-                     {
-                        continue;
-                     }
-
-                     count += counts[sumRast.flattenIndex((size_t)ri, (size_t) ci)];
-                     sum += sumRast.at((size_t)ri, (size_t)ci);
+                     sums[k] += local[u][k];
+                     counts[k] += local[u][N + k];
                   }
                }
-               if (count != 0)
-               {
-                  outRast.at((size_t)r,(size_t) c) = sum / count;
-               }
             }
          }
+         else
+#endif
+         {
+            scatter(0, objs.size(), sums.data(), counts.data());
+         }
 
-         return outRast;
+         return BasicRaster::rasterizeMean(ref, sums, counts, width);
+      }
+
+      enum RasterizeStatistic : unsigned
+      {
+         Mean     = 1 << 0, // Mean of the attributes, 0 without objects as Rasterize
+         Sum      = 1 << 1, // Sum of the attributes, 0 without objects
+         Max      = 1 << 2, // Largest attribute, nodata without objects
+         Min      = 1 << 3, // Smallest attribute, nodata without objects
+         Count    = 1 << 4, // Number of objects
+         Variance = 1 << 5, // Population variance of the attributes, nodata without objects
+      };
+
+      // Outputs of RasterizeStatistics, defined after BasicRaster
+      struct RasterizedStatistics;
+
+      /**
+       * @brief Rasterize computing several statistics of the attributes of the objects of every cell in a single scan
+       * of the objects. Cells that are nodata in ref are nodata in every output.
+       *
+       * @tparam O obj
+       * @param ref Reference raster to determine shape, size, nodata, etc
+       * @param objs vector of objects
+       * @param getPos Callable or pointer to member giving the position of an object
+       * @param getAttr Callable or pointer to member giving the attribute to rasterize
+       * @param statistics RasterizeStatistic values to compute, combined with |
+       * @param quantiles Probabilities in [0, 1] of the quantiles to compute, interpolated linearly between the
+       * attributes of a cell, nodata without objects
+       * @return RasterizedStatistics Requested statistics
+       */
+      template <class O, class GetPos, class GetAttr>
+      static RasterizedStatistics RasterizeStatistics(
+         const BasicRaster &ref, const std::vector<O> &objs, GetPos getPos, GetAttr getAttr, unsigned statistics,
+         const std::vector<double> &quantiles = {})
+      {
+         // Cell and attribute of every object, gathered in parallel
+         std::vector<size_t> inds(objs.size());
+         std::vector<double> values(objs.size());
+#pragma omp parallel for schedule(static) if (objs.size() > (1 << 14))
+         for (long i = 0; i < static_cast<long>(objs.size()); i++)
+         {
+            inds[i]   = ref.getNearestCell(std::invoke(getPos, objs[i]));
+            values[i] = static_cast<double>(std::invoke(getAttr, objs[i]));
+         }
+
+         return BasicRaster::rasterizeStatistics(ref, inds, values, statistics, quantiles);
       }
 
       double                     GetAverage(size_t ind, double radius) const;
-      static std::vector<size_t> getValidIndices(const std::vector<const KiLib::Raster *> &rasts);
-      static void                assertAgreeDim(const std::vector<const KiLib::Raster *> &rasts);
-      std::optional<KiLib::Vec3> GetCoordMinDistance(size_t ind, const KiLib::Vec3 &inPos, const KiLib::Raster &elev, double radius, double threshold) const;
+
+      /**
+       * @brief Mean of the valid cells within radius of every valid cell, as GetAverage gives for each of them, in one
+       * parallel pass. The disk is measured once as one run of columns per row, and each run is summed from running
+       * row sums.
+       *
+       * @param radius [m] Radius to average over
+       * @return BasicRaster<double> Means, nodata where this raster has nodata
+       */
+      BasicRaster<double>        ComputeAverage(double radius) const;
+      static BasicRaster<double> ComputeAverage(const BasicRasterView<const T> &inp, double radius);
+      // Cells that are valid in every raster of rasts, as a bitmap or as flat indices in increasing order
+      static ValidityMask        getValidMask(const std::vector<const BasicRaster *> &rasts);
+      static std::vector<size_t> getValidIndices(const std::vector<const BasicRaster *> &rasts);
+      static void                assertAgreeDim(const std::vector<const BasicRaster *> &rasts);
+      // StreamIndex answers both searches below without scanning the whole square when repeated on the same streams
+      std::optional<KiLib::Vec3> GetCoordMinDistance(size_t ind, const KiLib::Vec3 &inPos, const BasicRaster &elev, double radius, double threshold) const;
       //GetCoordMinDistance(size_t ind, double zInd, const KiLib::Raster &elev, double radius, double threshold) const;
-      std::optional<KiLib::Vec3> FindClosestStreamCell(size_t ind, const KiLib::Vec3 &inPos, const KiLib::Raster &elev, double radius, double threshold, double shape, double runoutAngle, double &runoutProb) const;
+      std::optional<KiLib::Vec3> FindClosestStreamCell(size_t ind, const KiLib::Vec3 &inPos, const BasicRaster &elev, double radius, double threshold, double shape, double runoutAngle, double &runoutProb) const;
 
    private:
-      void fromDEM(const std::string &path);
-      void fromTiff(const std::string &path);
+      // Picks the window to load from a raster holding the metadata of the whole file
+      using WindowResolver = std::function<RasterWindow(const BasicRaster &)>;
+
+      void         fromFile(const std::string &path, const WindowResolver &window);
+      void         fromDEM(const std::string &path, const WindowResolver &window);
+      void         fromTiff(const std::string &path, const WindowResolver &window);
+      void         fromNative(const std::string &path, const WindowResolver &window);
+      void         applyWindow(const RasterWindow &window);
       void toDEM(const std::string &path) const;
-      void toTiff(const std::string &path) const;
+      void toTiff(const std::string &path, const TiffOptions &options) const;
+      void toNative(const std::string &path) const;
 
       double getInterpBilinear(const Vec3 &pos) const;
+
+      // Means of Rasterize over the square windows of side 2 * width + 1, from the sums and counts of every cell
+      static BasicRaster<double> rasterizeMean(
+         const BasicRaster &ref, const std::vector<double> &sums, const std::vector<double> &counts, int width);
+
+      // Statistics of RasterizeStatistics from the cell and attribute of every object
+      static RasterizedStatistics rasterizeStatistics(
+         const BasicRaster &ref, const std::vector<size_t> &inds, const std::vector<double> &values,
+         unsigned statistics, const std::vector<double> &quantiles);
    };
 
+   // Derivatives that were not requested from ComputeTerrainDerivatives are empty. They are doubles whatever the cell
+   // type of the elevations.
+   template <class T>
+   struct BasicRaster<T>::TerrainDerivatives
+   {
+      BasicRaster<double> slope;
+      BasicRaster<double> aspect;
+      BasicRaster<double> profileCurvature;
+      BasicRaster<double> planCurvature;
+      BasicRaster<double> totalCurvature;
+   };
+
+   // Statistics that were not requested from RasterizeStatistics are empty. They are doubles whatever the cell type of
+   // the reference raster.
+   template <class T>
+   struct BasicRaster<T>::RasterizedStatistics
+   {
+      BasicRaster<double>              mean;
+      BasicRaster<double>              sum;
+      BasicRaster<double>              max;
+      BasicRaster<double>              min;
+      BasicRaster<double>              count;
+      BasicRaster<double>              variance;
+      std::vector<BasicRaster<double>> quantiles; // One per requested probability, in the same order
+   };
+
+   // Double precision raster, the default used throughout KiLib
+   using Raster = BasicRaster<double>;
+
 } // namespace KiLib
@@ -0,0 +1,257 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Raster/RasterView.hpp>
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+namespace KiLib
+{
+   RasterWindow ClipWindow(RasterWindow window, size_t nRows, size_t nCols)
+   {
+      if (window.row >= nRows || window.col >= nCols)
+      {
+         throw std::invalid_argument(fmt::format(
+            "Window starting at row {}, col {} is outside of the {}x{} raster", window.row, window.col, nRows, nCols));
+      }
+
+      if (window.nRows == 0 || window.nRows > nRows - window.row)
+         window.nRows = nRows - window.row;
+      if (window.nCols == 0 || window.nCols > nCols - window.col)
+         window.nCols = nCols - window.col;
+
+      return window;
+   }
+
+   std::vector<long> DiskHalfWidths(double radius, double cellsize)
+   {
+      auto inside = [&](long dr, long dc)
+      {
+         const double y = dr * cellsize;
+         const double x = dc * cellsize;
+         return std::sqrt(y * y + x * x) <= radius;
+      };
+
+      // Runs narrow away from the centre, so their half widths are found in a single sweep
+      std::vector<long> halfWidths;
+      const long        extent = static_cast<long>(std::floor(radius / cellsize));
+      for (long dr = 0, h = extent; dr <= extent; dr++)
+      {
+         while (h >= 0 && !inside(dr, h))
+            h--;
+         if (h < 0)
+            break;
+         halfWidths.push_back(h);
+      }
+      return halfWidths;
+   }
+
+   template <class T>
+   T &BasicRasterView<T>::at(size_t row, size_t col) const
+   {
+      if (row >= this->nRows || col >= this->nCols)
+      {
+         throw std::out_of_range(
+            fmt::format("Cell ({}, {}) out of range for a {}x{} raster view", row, col, this->nRows, this->nCols));
+      }
+      return this->operator()(row, col);
+   }
+
+   template <class T>
+   T &BasicRasterView<T>::at(size_t ind) const
+   {
+      if (ind >= this->nData)
+      {
+         throw std::out_of_range(
+            fmt::format("Index {} out of range for a raster view with {} datapoints", ind, this->nData));
+      }
+      return this->operator()(ind);
+   }
+
+   template <class T>
+   BasicRasterView<T> BasicRasterView<T>::subView(RasterWindow window) const
+   {
+      window = ClipWindow(window, this->nRows, this->nCols);
+      return BasicRasterView(
+         &this->operator()(window.row, window.col), window.nRows, window.nCols, this->stride,
+         this->xllcorner + window.col * this->cellsize, this->yllcorner + window.row * this->cellsize, this->cellsize,
+         this->nodata_value);
+   }
+
+   // Corner offsets and fractions of the position (px, py), shared by both getInterpBilinear overloads so they agree
+   // everywhere. Positions left of or below the raster take the value of its edge, positions right of or above it have
+   // both corners on the edge. Indices are clamped as doubles, by value rather than with std::min, and converted
+   // through int, so loops calling this vectorize with corner loads as gathers. NaN coordinates read the first cell
+   // and give NaN.
+   static inline void _BilinearCorners(
+      double px, double py, double x0, double y0, double cs, double lastRow, double lastCol, long stride, long &o00,
+      long &o10, long &o01, long &o11, double &sx, double &sy)
+   {
+      const double x  = (px - x0) / cs;
+      const double y  = (py - y0) / cs;
+      const double fx = std::floor(x);
+      const double fy = std::floor(y);
+      const double c  = fx >= 0 ? (fx <= lastCol ? fx : lastCol) : 0;
+      const double r  = fy >= 0 ? (fy <= lastRow ? fy : lastRow) : 0;
+      o00             = static_cast<long>(static_cast<int>(r)) * stride + static_cast<int>(c);
+      o10             = o00 + (c < lastCol ? 1 : 0);
+      o01             = o00 + (r < lastRow ? stride : 0);
+      o11             = o01 + (c < lastCol ? 1 : 0);
+      sx              = fx < 0 ? 0 : x - fx;
+      sy              = fy < 0 ? 0 : y - fy;
+   }
+
+   // Returns (bilinear) interpolated data value at specified position
+   // Takes in a vec3 for convenience, ignores Z
+   template <class T>
+   double BasicRasterView<T>::getInterpBilinear(const Vec3 &pos) const
+   {
+      long   o00, o10, o01, o11;
+      double sx, sy;
+      _BilinearCorners(
+         pos.x, pos.y, this->xllcorner, this->yllcorner, this->cellsize, static_cast<double>(this->nRows - 1),
+         static_cast<double>(this->nCols - 1), static_cast<long>(this->stride), o00, o10, o01, o11, sx, sy);
+
+      const double f00 = this->cells[o00];
+      const double f10 = this->cells[o10];
+      const double f01 = this->cells[o01];
+      const double f11 = this->cells[o11];
+
+      const double val = f00 * (1.0 - sx) * (1.0 - sy) + f10 * sx * (1.0 - sy) + f01 * (1.0 - sx) * sy + f11 * sx * sy;
+
+      return val;
+   }
+
+   template <class T>
+   void BasicRasterView<T>::getInterpBilinear(
+      std::span<const double> x, std::span<const double> y, std::span<double> z, bool skipNoData) const
+   {
+      if (y.size() != x.size() || z.size() != x.size())
+         throw std::invalid_argument("Coordinates and values must have the same size");
+
+      const long    n       = static_cast<long>(x.size());
+      const double *px      = x.data();
+      const double *py      = y.data();
+      double       *pz      = z.data();
+      const T      *cells   = this->cells;
+      const long    stride  = static_cast<long>(this->stride);
+      const double  x0      = this->xllcorner;
+      const double  y0      = this->yllcorner;
+      const double  cs      = this->cellsize;
+      const double  lastRow = static_cast<double>(this->nRows - 1);
+      const double  lastCol = static_cast<double>(this->nCols - 1);
+      const double  nodata  = this->nodata_value;
+
+      if (!skipNoData)
+      {
+#pragma omp parallel for simd schedule(static) if (n > (1 << 14))
+         for (long i = 0; i < n; i++)
+         {
+            long   o00, o10, o01, o11;
+            double sx, sy;
+            _BilinearCorners(px[i], py[i], x0, y0, cs, lastRow, lastCol, stride, o00, o10, o01, o11, sx, sy);
+            const double f00 = cells[o00];
+            const double f10 = cells[o10];
+            const double f01 = cells[o01];
+            const double f11 = cells[o11];
+            pz[i] = f00 * (1.0 - sx) * (1.0 - sy) + f10 * sx * (1.0 - sy) + f01 * (1.0 - sx) * sy + f11 * sx * sy;
+         }
+         return;
+      }
+
+#pragma omp parallel for simd schedule(static) if (n > (1 << 14))
+      for (long i = 0; i < n; i++)
+      {
+         long   o00, o10, o01, o11;
+         double sx, sy;
+         _BilinearCorners(px[i], py[i], x0, y0, cs, lastRow, lastCol, stride, o00, o10, o01, o11, sx, sy);
+         const double f00 = cells[o00];
+         const double f10 = cells[o10];
+         const double f01 = cells[o01];
+         const double f11 = cells[o11];
+         const double w00 = (1.0 - sx) * (1.0 - sy);
+         const double w10 = sx * (1.0 - sy);
+         const double w01 = (1.0 - sx) * sy;
+         const double w11 = sx * sy;
+
+         // Both results are computed and one selected, which keeps the loop free of branches. When every corner is
+         // valid the value is exactly that of the plain interpolation.
+         const bool   v00 = f00 != nodata;
+         const bool   v10 = f10 != nodata;
+         const bool   v01 = f01 != nodata;
+         const bool   v11 = f11 != nodata;
+         const double all =
+            f00 * (1.0 - sx) * (1.0 - sy) + f10 * sx * (1.0 - sy) + f01 * (1.0 - sx) * sy + f11 * sx * sy;
+         const double sum =
+            (v00 ? f00 * w00 : 0) + (v10 ? f10 * w10 : 0) + (v01 ? f01 * w01 : 0) + (v11 ? f11 * w11 : 0);
+         const double known = (v00 ? w00 : 0) + (v10 ? w10 : 0) + (v01 ? w01 : 0) + (v11 ? w11 : 0);
+         pz[i]              = (v00 & v10 & v01 & v11) ? all : (known > 0 ? sum / known : nodata);
+      }
+   }
+
+   template <class T>
+   double BasicRasterView<T>::GetAverage(size_t ind, double radius) const
+   {
+      if (ind >= this->nData)
+      {
+         throw std::out_of_range(fmt::format("Index {} out of range for Raster with {} datapoints", ind, this->nData));
+      }
+
+      const long r = static_cast<long>(ind / this->nCols);
+      const long c = static_cast<long>(ind % this->nCols);
+
+      // Rows of the disk from the bottom up, clipped to the view
+      const std::vector<long> half  = DiskHalfWidths(radius, this->cellsize);
+      const long              reach = static_cast<long>(half.size()) - 1;
+
+      double sum = 0.0;
+      double num = 0.0;
+      for (long ri = std::max(r - reach, 0L); ri <= std::min(r + reach, (long)this->nRows - 1); ri++)
+      {
+         const long h = half[std::abs(ri - r)];
+         for (long ci = std::max(c - h, 0L); ci <= std::min(c + h, (long)this->nCols - 1); ci++)
+         {
+            // Skip nodata
+            if (this->operator()(ri, ci) == this->nodata_value)
+            {
+               continue;
+            }
+            sum += this->operator()(ri, ci);
+            num += 1;
+         }
+      }
+
+      if (num == 0)
+      {
+         num += 1;
+      }
+
+      return sum / num;
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template class BasicRasterView<T>;                                                                                  \
+   template class BasicRasterView<const T>;
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
@@ -0,0 +1,226 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <KiLib/Utils/Vec3.hpp>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace KiLib
+{
+   /**
+    * @brief Rectangle of cells to load from a raster file or to view in a raster. Rows count up from the bottom of the
+    * raster, like the rows of BasicRaster. Windows reaching past the raster are clipped to it.
+    */
+   struct RasterWindow
+   {
+      size_t row   = 0; // First (bottom) row
+      size_t col   = 0; // First (left) column
+      size_t nRows = 0; // Number of rows, 0 loads up to the top of the raster
+      size_t nCols = 0; // Number of columns, 0 loads up to the right edge of the raster
+   };
+
+   /**
+    * @brief Clips window to a raster of nRows by nCols cells, filling in sizes left at 0
+    *
+    * @param window Window to clip
+    * @param nRows Number of rows of the raster
+    * @param nCols Number of columns of the raster
+    * @return RasterWindow Window inside of the raster. Throws std::invalid_argument if window starts outside of it.
+    */
+   RasterWindow ClipWindow(RasterWindow window, size_t nRows, size_t nCols);
+
+   /**
+    * @brief Shape of the disk of cells averaged by GetAverage, ComputeAverage and SummedAreaTable::GetAverage: the
+    * cells whose centre is within radius of the centre cell
+    *
+    * @param radius [m] Radius of the disk
+    * @param cellsize [m] Distance between cells
+    * @return std::vector<long> Half width of every row of the disk, row dr above or below the centre spanning columns
+    * -halfWidths[dr] to halfWidths[dr]. Empty if radius is negative.
+    */
+   std::vector<long> DiskHalfWidths(double radius, double cellsize);
+
+   /**
+    * @brief Non-owning view of raster cells stored elsewhere (a BasicRaster, a mapped file or a buffer owned by the
+    * caller). Rows are stride cells apart, so a view can cover a window of a larger raster without copying it. Like
+    * std::span, copying a view never copies cells and constness of the view does not apply to the cells.
+    *
+    * @tparam T Cell type, const for read-only views
+    */
+   template <class T>
+   class BasicRasterView
+   {
+   public:
+      using value_type = std::remove_const_t<T>;
+
+      double xllcorner    = 0; // Lower left corner x value in absolute coordinates
+      double yllcorner    = 0; // Lower left corner y value in absolute coordinates
+      double cellsize     = 0; // [m] Distance between values
+      double width        = 0; // [m] Width in X
+      double height       = 0; // [m] Height in Y
+      double nodata_value = 0; // Value associated with no data
+
+      size_t nCols  = 0; // Number of columns (x)
+      size_t nRows  = 0; // Number of rows (y)
+      size_t nData  = 0; // Total number of datapoints
+      size_t stride = 0; // Number of cells between the starts of two consecutive rows
+
+      BasicRasterView() = default;
+
+      /**
+       * @brief Views nRows rows of nCols cells starting at cells, row 0 (the bottom row) first
+       *
+       * @param cells First cell of the bottom row
+       * @param nRows Number of rows
+       * @param nCols Number of columns
+       * @param stride Number of cells between the starts of two consecutive rows, at least nCols
+       * @param xllcorner Lower left corner x value in absolute coordinates
+       * @param yllcorner Lower left corner y value in absolute coordinates
+       * @param cellsize Distance between values
+       * @param nodata_value Value associated with no data
+       */
+      BasicRasterView(
+         T *cells, size_t nRows, size_t nCols, size_t stride, double xllcorner, double yllcorner, double cellsize,
+         double nodata_value)
+         : xllcorner(xllcorner), yllcorner(yllcorner), cellsize(cellsize), width(nCols * cellsize),
+           height(nRows * cellsize), nodata_value(nodata_value), nCols(nCols), nRows(nRows), nData(nRows * nCols),
+           stride(stride), cells(cells)
+      {
+         if (stride < nCols)
+            throw std::invalid_argument("Raster view stride must be at least the number of columns");
+      }
+
+      // Read-write views convert to read-only ones
+      template <class U, class = std::enable_if_t<std::is_same_v<const U, T> && !std::is_same_v<U, T>>>
+      BasicRasterView(const BasicRasterView<U> &other)
+         : BasicRasterView(
+              other.data(), other.nRows, other.nCols, other.stride, other.xllcorner, other.yllcorner, other.cellsize,
+              other.nodata_value)
+      {
+      }
+
+      /**
+       * @brief Returns the first cell of the bottom row
+       */
+      T *data() const
+      {
+         return this->cells;
+      }
+
+      /**
+       * @brief Whether rows follow each other without gaps, so data() holds nData consecutive cells
+       */
+      bool isContiguous() const
+      {
+         return this->stride == this->nCols || this->nRows <= 1;
+      }
+
+      /**
+       * @brief Returns a reference to the (row, col) index into the view. Doesn't do bounds checking.
+       */
+      T &operator()(size_t row, size_t col) const
+      {
+         return this->cells[row * this->stride + col];
+      }
+
+      /**
+       * @brief Returns a reference to the flat index (row * nCols + col) into the view. Doesn't do bounds checking.
+       */
+      T &operator()(size_t ind) const
+      {
+         return this->operator()(ind / this->nCols, ind % this->nCols);
+      }
+
+      /**
+       * @brief Returns a reference to the (row, col) index into the view. Does bounds checking.
+       */
+      T &at(size_t row, size_t col) const;
+
+      /**
+       * @brief Returns a reference to the flat index into the view. Does bounds checking.
+       */
+      T &at(size_t ind) const;
+
+      /**
+       * @brief Interpolates the value at pos (takes in 3D vector but ignores Z)
+       *
+       * @param pos Pos to interpolate
+       * @return double Value, using bilinear interpolation
+       */
+      double operator()(const Vec3 &pos) const
+      {
+         return this->getInterpBilinear(pos);
+      }
+
+      /**
+       * @brief Interpolates the value at pos (takes in 3D vector but ignores Z). Positions outside of the view take
+       * the value of its nearest edge.
+       *
+       * @param pos Pos to interpolate
+       * @return double Value, using bilinear interpolation
+       */
+      double getInterpBilinear(const Vec3 &pos) const;
+
+      /**
+       * @brief Interpolates the values at many positions given as separate x and y arrays, in parallel and vectorized.
+       * Values are exactly those of getInterpBilinear for the same positions.
+       *
+       * @param x X coordinates of the positions
+       * @param y Y coordinates of the positions, as many as x
+       * @param z Receives the interpolated values, as many as x
+       * @param skipNoData If true, corners holding nodata are left out and the weights of the others rescaled, and
+       * positions with no weight on a valid corner get nodata. Otherwise nodata is interpolated like any value.
+       */
+      void getInterpBilinear(
+         std::span<const double> x, std::span<const double> y, std::span<double> z, bool skipNoData = false) const;
+
+      /**
+       * @brief Mean of the valid cells within radius of the cell at flat index ind (see DiskHalfWidths). Scans every
+       * cell of the disk; SummedAreaTable answers repeated queries in O(radius).
+       *
+       * @param ind Flat index
+       * @param radius [m] Radius to average over
+       * @return double Mean, 0 if there is no valid cell
+       */
+      double GetAverage(size_t ind, double radius) const;
+
+      /**
+       * @brief Returns a view of a window of this view, sharing its cells and stride
+       *
+       * @param window Rows and columns to view, clipped to this view. Throws std::invalid_argument if it starts
+       * outside of it.
+       * @return BasicRasterView View of the window
+       */
+      BasicRasterView subView(RasterWindow window) const;
+
+   private:
+      T *cells = nullptr;
+   };
+
+   // Read-only view of double precision cells
+   using RasterView = BasicRasterView<const double>;
+
+} // namespace KiLib
@@ -0,0 +1,223 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <KiLib/Raster/StreamIndex.hpp>
+#include <KiLib/Utils/Distributions.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace KiLib
+{
+   template <class T>
+   StreamIndex::StreamIndex(const BasicRasterView<const T> &streams, double threshold, size_t blockSize)
+      : xllcorner(streams.xllcorner), yllcorner(streams.yllcorner), cellsize(streams.cellsize), nRows(streams.nRows),
+        nCols(streams.nCols), blockSize(std::max<size_t>(blockSize, 1))
+   {
+      const size_t B          = this->blockSize;
+      const size_t nBlockRows = (this->nRows + B - 1) / B;
+      this->nBlockCols        = (this->nCols + B - 1) / B;
+
+      auto isStream = [&](size_t r, size_t c)
+      { return streams(r, c) != streams.nodata_value && streams(r, c) >= threshold; };
+
+      // Counts the cells of every block, then places them
+      this->blockStart.assign(nBlockRows * this->nBlockCols + 1, 0);
+      for (size_t r = 0; r < this->nRows; r++)
+         for (size_t c = 0; c < this->nCols; c++)
+            if (isStream(r, c))
+               this->blockStart[(r / B) * this->nBlockCols + c / B + 1]++;
+      for (size_t b = 1; b < this->blockStart.size(); b++)
+         this->blockStart[b] += this->blockStart[b - 1];
+
+      this->cells.resize(this->blockStart.back());
+      std::vector<size_t> next(this->blockStart.begin(), this->blockStart.end() - 1);
+      for (size_t r = 0; r < this->nRows; r++)
+         for (size_t c = 0; c < this->nCols; c++)
+            if (isStream(r, c))
+               this->cells[next[(r / B) * this->nBlockCols + c / B]++] = {(uint32_t)r, (uint32_t)c};
+   }
+
+   void StreamIndex::checkQuery(size_t ind, const RasterView &elev) const
+   {
+      if (ind >= this->nRows * this->nCols)
+      {
+         throw std::out_of_range(
+            fmt::format("Index {} out of range for Raster with {} datapoints", ind, this->nRows * this->nCols));
+      }
+      if (elev.nRows != this->nRows || elev.nCols != this->nCols)
+         throw std::invalid_argument("Elevations must have the size of the indexed raster");
+   }
+
+   template <class F>
+   void StreamIndex::search(size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius, F f) const
+   {
+      const long   r      = static_cast<long>(ind / this->nCols);
+      const long   c      = static_cast<long>(ind % this->nCols);
+      const long   extent = static_cast<long>(std::floor(radius / this->cellsize));
+      const long   leftB  = std::clamp(c - extent, 0L, (long)this->nCols - 1);
+      const long   rightB = std::clamp(c + extent, 0L, (long)this->nCols - 1);
+      const long   upB    = std::clamp(r + extent, 0L, (long)this->nRows - 1);
+      const long   lowB   = std::clamp(r - extent, 0L, (long)this->nRows - 1);
+      const long   B      = static_cast<long>(this->blockSize);
+      const double cs     = this->cellsize;
+
+      // The blocks of a row of blocks are consecutive, so the cells of the blocks overlapping the square are too
+      for (long br = lowB / B; br <= upB / B; br++)
+      {
+         const size_t first = this->blockStart[br * this->nBlockCols + leftB / B];
+         const size_t last  = this->blockStart[br * this->nBlockCols + rightB / B + 1];
+         for (size_t i = first; i < last; i++)
+         {
+            const long ri = this->cells[i].row;
+            const long ci = this->cells[i].col;
+            if (ri < lowB || ri > upB || ci < leftB || ci > rightB)
+               continue;
+
+            const double dr   = inPos.y - (this->yllcorner + static_cast<double>(ri) * cs + cs / 2.0);
+            const double dc   = inPos.x - (this->xllcorner + static_cast<double>(ci) * cs + cs / 2.0);
+            const double dist = std::sqrt(dr * dr + dc * dc);
+            if (dist <= radius && elev(ri, ci) < inPos.z)
+               f(ri, ci, dist);
+         }
+      }
+   }
+
+   std::optional<KiLib::Vec3> StreamIndex::GetCoordMinDistance(
+      size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius) const
+   {
+      // Ties go to the last cell in row major order, as in BasicRaster::GetCoordMinDistance
+      double bestDist = std::numeric_limits<double>::max();
+      long   bestR = -1, bestC = -1;
+      this->checkQuery(ind, elev);
+      this->search(
+         ind, inPos, elev, radius,
+         [&](long ri, long ci, double dist)
+         {
+            if (dist < bestDist || (dist == bestDist && (ri > bestR || (ri == bestR && ci > bestC))))
+            {
+               bestDist = dist;
+               bestR    = ri;
+               bestC    = ci;
+            }
+         });
+
+      if (bestR < 0)
+         return std::nullopt;
+      return KiLib::Vec3(this->xllcorner + bestC * this->cellsize, this->yllcorner + bestR * this->cellsize, 0);
+   }
+
+   std::optional<KiLib::Vec3> StreamIndex::FindClosestStreamCell(
+      size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius, double shape, double runoutAngle,
+      double &runoutProb) const
+   {
+      // Ties go to the first cell in row major order, as in BasicRaster::FindClosestStreamCell
+      const double scale     = std::tan(runoutAngle);
+      double       maxRunout = std::numeric_limits<double>::min();
+      long         bestR = -1, bestC = -1;
+      this->checkQuery(ind, elev);
+      this->search(
+         ind, inPos, elev, radius,
+         [&](long ri, long ci, double dist)
+         {
+            const double slope  = (inPos.z - elev(ri, ci)) / dist;
+            const double runout = KiLib::weibullCDF(slope, shape, scale);
+            if (runout > maxRunout ||
+                (bestR >= 0 && runout == maxRunout && (ri < bestR || (ri == bestR && ci < bestC))))
+            {
+               maxRunout = runout;
+               bestR     = ri;
+               bestC     = ci;
+            }
+         });
+
+      if (bestR < 0)
+         return std::nullopt;
+      runoutProb = maxRunout;
+      return KiLib::Vec3(this->xllcorner + bestC * this->cellsize, this->yllcorner + bestR * this->cellsize, 0);
+   }
+
+   size_t StreamIndex::FindClosestStreamCells(
+      std::span<const size_t> inds, std::span<const KiLib::Vec3> inPos, const RasterView &elev, double radius,
+      double shape, double runoutAngle, std::span<KiLib::Vec3> pos, std::span<double> runoutProb) const
+   {
+      const size_t n = inds.size();
+      if (inPos.size() != n || pos.size() != n || runoutProb.size() != n)
+         throw std::invalid_argument("Indices, positions and results must have the same size");
+      const double scale = std::tan(runoutAngle);
+      if (!(shape > 0) || !(scale > 0))
+         throw std::invalid_argument("Runout needs a positive shape and a runout angle in (0, pi / 2)");
+
+      // Queries run block by block so the stream cells and elevations they visit are shared with the previous ones
+      std::vector<std::pair<size_t, size_t>> order(n);
+      for (size_t q = 0; q < n; q++)
+      {
+         this->checkQuery(inds[q], elev);
+         const size_t r = inds[q] / this->nCols, c = inds[q] % this->nCols;
+         order[q]       = {(r / this->blockSize) * this->nBlockCols + c / this->blockSize, q};
+      }
+      std::sort(order.begin(), order.end());
+
+      size_t nFound = 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+ : nFound)
+      for (size_t k = 0; k < n; k++)
+      {
+         const size_t       q = order[k].second;
+         const KiLib::Vec3 &p = inPos[q];
+
+         // The runout probability grows with the slope, so the steepest cell is the most likely one and the Weibull
+         // distribution is evaluated once per query
+         double maxSlope = -1;
+         long   bestR = -1, bestC = -1;
+         this->search(
+            inds[q], p, elev, radius,
+            [&](long ri, long ci, double dist)
+            {
+               const double slope = (p.z - elev(ri, ci)) / dist;
+               if (slope > maxSlope || (slope == maxSlope && (ri < bestR || (ri == bestR && ci < bestC))))
+               {
+                  maxSlope = slope;
+                  bestR    = ri;
+                  bestC    = ci;
+               }
+            });
+
+         const double runout = bestR < 0 ? 0 : KiLib::weibullCDF(maxSlope, shape, scale);
+         if (runout > std::numeric_limits<double>::min())
+         {
+            pos[q] = KiLib::Vec3(this->xllcorner + bestC * this->cellsize, this->yllcorner + bestR * this->cellsize, 0);
+            runoutProb[q] = runout;
+            nFound++;
+         }
+         else
+         {
+            runoutProb[q] = 0;
+         }
+      }
+      return nFound;
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template StreamIndex::StreamIndex(const BasicRasterView<const T> &streams, double threshold, size_t blockSize);
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
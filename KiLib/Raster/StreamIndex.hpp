@@ -0,0 +1,143 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Utils/Vec3.hpp>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace KiLib
+{
+   /**
+    * @brief Spatial index of the stream cells of a raster, its valid cells at or above a threshold, bucketed in square
+    * blocks of cells. Searches through the index visit only the stream cells of the blocks around the search square,
+    * so their cost follows the local density of streams instead of the square of the radius. The index does not
+    * follow later changes to the raster.
+    */
+   class StreamIndex
+   {
+   public:
+      double xllcorner = 0; // Lower left corner x value in absolute coordinates
+      double yllcorner = 0; // Lower left corner y value in absolute coordinates
+      double cellsize  = 0; // [m] Distance between values
+      size_t nRows     = 0; // Number of rows of the raster
+      size_t nCols     = 0; // Number of columns of the raster
+
+      StreamIndex() = default;
+
+      /**
+       * @brief Indexes the cells of streams at or above threshold
+       *
+       * @param streams Raster marking streams, such as a flow accumulation
+       * @param threshold Smallest value of a stream cell
+       * @param blockSize Side of the blocks of cells, in cells
+       */
+      template <class T>
+      StreamIndex(const BasicRasterView<const T> &streams, double threshold, size_t blockSize = 16);
+
+      template <class T>
+      StreamIndex(const BasicRaster<T> &streams, double threshold, size_t blockSize = 16)
+         : StreamIndex(streams.view(), threshold, blockSize)
+      {
+      }
+
+      /**
+       * @brief Number of stream cells
+       */
+      size_t size() const
+      {
+         return this->cells.size();
+      }
+
+      /**
+       * @brief Same as BasicRaster::GetCoordMinDistance called on the indexed raster with the same threshold: the
+       * closest stream cell lower than inPos.z, among those in the square of side 2 * floor(radius / cellsize) + 1
+       * centred on ind and within radius of inPos
+       *
+       * @param ind Flat index of the cell the square is centred on
+       * @param inPos Position searched from
+       * @param elev Elevations, with the size of the indexed raster
+       * @param radius [m] Search radius
+       * @return std::optional<KiLib::Vec3> Lower left corner of the cell (with z = 0), nullopt if there is none
+       */
+      std::optional<KiLib::Vec3>
+         GetCoordMinDistance(size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius) const;
+
+      /**
+       * @brief Same as BasicRaster::FindClosestStreamCell called on the indexed raster with the same threshold: the
+       * stream cell of the search of GetCoordMinDistance with the highest Weibull runout probability
+       *
+       * @param ind Flat index of the cell the square is centred on
+       * @param inPos Position searched from
+       * @param elev Elevations, with the size of the indexed raster
+       * @param radius [m] Search radius
+       * @param shape Shape of the Weibull distribution of the slope to the stream cell
+       * @param runoutAngle [rad] Runout angle, whose tangent is the scale of the Weibull distribution
+       * @param runoutProb Receives the runout probability of the cell found
+       * @return std::optional<KiLib::Vec3> Lower left corner of the cell (with z = 0), nullopt if there is none
+       */
+      std::optional<KiLib::Vec3> FindClosestStreamCell(
+         size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius, double shape, double runoutAngle,
+         double &runoutProb) const;
+
+      /**
+       * @brief FindClosestStreamCell for many queries at once, run in parallel. Queries are reordered by block so
+       * neighbouring queries share cached cells. The probabilities are those of FindClosestStreamCell; when several
+       * cells round to the same highest probability, the steepest one is returned.
+       *
+       * @param inds Flat index of the cell each search square is centred on
+       * @param inPos Position each query searches from
+       * @param elev Elevations, with the size of the indexed raster
+       * @param radius [m] Search radius
+       * @param shape Shape of the Weibull distribution of the slope to the stream cell, positive
+       * @param runoutAngle [rad] Runout angle, whose tangent is the scale of the Weibull distribution
+       * @param pos Receives the lower left corner (with z = 0) of the cell found by each query, left unchanged if there
+       * is none
+       * @param runoutProb Receives the runout probability of each query, 0 if no cell is found
+       * @return size_t Number of queries that found a cell
+       */
+      size_t FindClosestStreamCells(
+         std::span<const size_t> inds, std::span<const KiLib::Vec3> inPos, const RasterView &elev, double radius,
+         double shape, double runoutAngle, std::span<KiLib::Vec3> pos, std::span<double> runoutProb) const;
+
+   private:
+      struct Cell
+      {
+         uint32_t row, col;
+      };
+
+      size_t blockSize   = 1;
+      size_t nBlockCols  = 0;
+      // Stream cells block by block, row by row within a block
+      std::vector<Cell>   cells;
+      // First cell of every block, blocks numbered row by row, and the end of the last block
+      std::vector<size_t> blockStart;
+
+      // Throws unless ind and elev fit the indexed raster
+      void checkQuery(size_t ind, const RasterView &elev) const;
+
+      // Calls f(row, col, distance) for every stream cell of the search around ind and inPos, in no particular order
+      template <class F>
+      void search(size_t ind, const KiLib::Vec3 &inPos, const RasterView &elev, double radius, F f) const;
+   };
+} // namespace KiLib
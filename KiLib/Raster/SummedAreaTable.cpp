@@ -0,0 +1,179 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <KiLib/Raster/SummedAreaTable.hpp>
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace KiLib
+{
+   template <class T>
+   SummedAreaTable::SummedAreaTable(const BasicRasterView<const T> &raster)
+      : nRows(raster.nRows), nCols(raster.nCols), cellsize(raster.cellsize)
+   {
+      const size_t width  = this->nCols + 1;
+      const double nodata = raster.nodata_value;
+      const long   nR     = static_cast<long>(this->nRows);
+      const size_t nC     = this->nCols;
+
+      for (size_t i = 0; i < raster.nData; i++)
+      {
+         if (raster(i) != nodata)
+         {
+            this->offset = raster(i);
+            break;
+         }
+      }
+
+      this->sums.assign((this->nRows + 1) * width, 0);
+      this->counts.assign((this->nRows + 1) * width, 0);
+      double   *sums   = this->sums.data();
+      uint32_t *counts = this->counts.data();
+
+      // Sums along every row, then down the columns
+      const double offset = this->offset;
+#pragma omp parallel for
+      for (long r = 0; r < nR; r++)
+      {
+         const T  *cells    = &raster(r, 0);
+         double   *rowSum   = sums + (r + 1) * width;
+         uint32_t *rowCount = counts + (r + 1) * width;
+         double    sum      = 0;
+         uint32_t  count    = 0;
+         for (size_t c = 0; c < nC; c++)
+         {
+            const bool valid = cells[c] != nodata;
+            sum += valid ? cells[c] - offset : 0;
+            count += valid;
+            rowSum[c + 1]   = sum;
+            rowCount[c + 1] = count;
+         }
+      }
+
+      const long block = 1024;
+#pragma omp parallel for
+      for (long c0 = 0; c0 < static_cast<long>(width); c0 += block)
+      {
+         const size_t c1 = std::min(width, static_cast<size_t>(c0 + block));
+         for (long r = 1; r < nR; r++)
+         {
+            double         *rowSum    = sums + (r + 1) * width;
+            const double   *prevSum   = sums + r * width;
+            uint32_t       *rowCount  = counts + (r + 1) * width;
+            const uint32_t *prevCount = counts + r * width;
+#pragma omp simd
+            for (size_t c = c0; c < c1; c++)
+            {
+               rowSum[c] += prevSum[c];
+               rowCount[c] += prevCount[c];
+            }
+         }
+      }
+   }
+
+   void SummedAreaTable::accumulate(size_t r0, size_t c0, size_t r1, size_t c1, double &sum, uint32_t &count) const
+   {
+      const size_t width = this->nCols + 1;
+      sum += this->sums[r1 * width + c1] - this->sums[r0 * width + c1] - this->sums[r1 * width + c0] +
+             this->sums[r0 * width + c0];
+      count += this->counts[r1 * width + c1] - this->counts[r0 * width + c1] - this->counts[r1 * width + c0] +
+               this->counts[r0 * width + c0];
+   }
+
+   double SummedAreaTable::average(double sum, uint32_t count) const
+   {
+      return count == 0 ? 0 : sum / count + this->offset;
+   }
+
+   double SummedAreaTable::GetWindowAverage(RasterWindow window) const
+   {
+      window         = ClipWindow(window, this->nRows, this->nCols);
+      double   sum   = 0;
+      uint32_t count = 0;
+      this->accumulate(window.row, window.col, window.row + window.nRows, window.col + window.nCols, sum, count);
+      return this->average(sum, count);
+   }
+
+   void SummedAreaTable::GetWindowSum(RasterWindow window, double &sum, size_t &count) const
+   {
+      window          = ClipWindow(window, this->nRows, this->nCols);
+      double   offSum = 0;
+      uint32_t valid  = 0;
+      this->accumulate(window.row, window.col, window.row + window.nRows, window.col + window.nCols, offSum, valid);
+
+      // Cells are stored less the offset
+      sum   = offSum + valid * this->offset;
+      count = valid;
+   }
+
+   double SummedAreaTable::GetSquareAverage(size_t ind, double radius) const
+   {
+      if (ind >= this->nRows * this->nCols)
+      {
+         throw std::out_of_range(
+            fmt::format("Index {} out of range for Raster with {} datapoints", ind, this->nRows * this->nCols));
+      }
+
+      const long r      = static_cast<long>(ind / this->nCols);
+      const long c      = static_cast<long>(ind % this->nCols);
+      const long extent = static_cast<long>(std::floor(radius / this->cellsize));
+
+      double   sum   = 0;
+      uint32_t count = 0;
+      this->accumulate(
+         std::max(r - extent, 0L), std::max(c - extent, 0L), std::min(r + extent + 1, (long)this->nRows),
+         std::min(c + extent + 1, (long)this->nCols), sum, count);
+      return this->average(sum, count);
+   }
+
+   double SummedAreaTable::GetAverage(size_t ind, double radius) const
+   {
+      if (ind >= this->nRows * this->nCols)
+      {
+         throw std::out_of_range(
+            fmt::format("Index {} out of range for Raster with {} datapoints", ind, this->nRows * this->nCols));
+      }
+
+      const long r = static_cast<long>(ind / this->nCols);
+      const long c = static_cast<long>(ind % this->nCols);
+
+      // Every row of the disk is a run of columns, summed in O(1)
+      const std::vector<long> half  = DiskHalfWidths(radius, this->cellsize);
+      double                  sum   = 0;
+      uint32_t                count = 0;
+      for (long dr = 0; dr < static_cast<long>(half.size()); dr++)
+      {
+         const size_t c0 = std::max(c - half[dr], 0L);
+         const size_t c1 = std::min(c + half[dr] + 1, (long)this->nCols);
+         if (r + dr < (long)this->nRows)
+            this->accumulate(r + dr, c0, r + dr + 1, c1, sum, count);
+         if (dr > 0 && r - dr >= 0)
+            this->accumulate(r - dr, c0, r - dr + 1, c1, sum, count);
+      }
+      return this->average(sum, count);
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T)                                                                                    \
+   template SummedAreaTable::SummedAreaTable(const BasicRasterView<const T> &raster);
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
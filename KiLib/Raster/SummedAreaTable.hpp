@@ -0,0 +1,109 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <KiLib/Raster/Raster.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace KiLib
+{
+   /**
+    * @brief Summed-area tables (integral images) of the valid cells of a raster and of their number. Once built, in
+    * one pass over the raster, they give the mean of the valid cells of any rectangle in O(1) and of any disk in
+    * O(radius), against O(radius^2) for BasicRasterView::GetAverage. The table does not follow later changes to the
+    * raster.
+    */
+   class SummedAreaTable
+   {
+   public:
+      size_t nRows    = 0; // Number of rows of the raster
+      size_t nCols    = 0; // Number of columns of the raster
+      double cellsize = 0; // [m] Distance between values
+
+      SummedAreaTable() = default;
+
+      /**
+       * @brief Builds the tables of raster, ignoring its nodata cells
+       */
+      template <class T>
+      explicit SummedAreaTable(const BasicRasterView<const T> &raster);
+
+      template <class T>
+      explicit SummedAreaTable(const BasicRaster<T> &raster) : SummedAreaTable(raster.view())
+      {
+      }
+
+      /**
+       * @brief Mean of the valid cells of window
+       *
+       * @param window Rows and columns to average, clipped to the raster. Throws std::invalid_argument if it starts
+       * outside of it.
+       * @return double Mean, 0 if there is no valid cell
+       */
+      double GetWindowAverage(RasterWindow window) const;
+
+      /**
+       * @brief Sum and number of the valid cells of window
+       *
+       * @param window Rows and columns to add up, clipped to the raster. Throws std::invalid_argument if it starts
+       * outside of it.
+       * @param sum Receives the sum of the valid cells
+       * @param count Receives the number of valid cells
+       */
+      void GetWindowSum(RasterWindow window, double &sum, size_t &count) const;
+
+      /**
+       * @brief Mean of the valid cells in the square of side 2 * floor(radius / cellsize) + 1 centred on the cell at
+       * flat index ind
+       *
+       * @param ind Flat index
+       * @param radius [m] Half side of the square
+       * @return double Mean, 0 if there is no valid cell
+       */
+      double GetSquareAverage(size_t ind, double radius) const;
+
+      /**
+       * @brief Mean of the valid cells within radius of the cell at flat index ind, the same as
+       * BasicRasterView::GetAverage
+       *
+       * @param ind Flat index
+       * @param radius [m] Radius to average over
+       * @return double Mean, 0 if there is no valid cell
+       */
+      double GetAverage(size_t ind, double radius) const;
+
+   private:
+      // Sums of the valid cells above and left of each corner of the raster, row by row with nCols + 1 corners per
+      // row. The first valid value is subtracted from every cell, which keeps the sums small.
+      std::vector<double> sums;
+
+      // Numbers of valid cells above and left of each corner. They may wrap around, which the differences giving the
+      // count of a rectangle undo.
+      std::vector<uint32_t> counts;
+
+      double offset = 0;
+
+      // Adds the sum and count of the valid cells of rows [r0, r1) and columns [c0, c1) to sum and count
+      void accumulate(size_t r0, size_t c0, size_t r1, size_t c1, double &sum, uint32_t &count) const;
+
+      double average(double sum, uint32_t count) const;
+   };
+} // namespace KiLib
@@ -0,0 +1,147 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Raster/ValidityMask.hpp>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace KiLib
+{
+   // Words per block of the parallel compaction of indices
+   static constexpr size_t compactionBlock = 1024;
+
+   // Bit j of a word. Looking bits up rather than shifting by the lane index lets the comparisons of a word vectorize
+   // without variable shifts.
+   static constexpr std::array<uint64_t, 64> bitOf = []
+   {
+      std::array<uint64_t, 64> bits{};
+      for (int j = 0; j < 64; j++)
+         bits[j] = uint64_t(1) << j;
+      return bits;
+   }();
+
+   ValidityMask::ValidityMask(size_t nRows, size_t nCols, bool valid)
+      : nRows(nRows), nCols(nCols), nData(nRows * nCols), bits((nRows * nCols + 63) / 64, valid ? ~uint64_t(0) : 0)
+   {
+      if (valid && this->nData % 64 != 0)
+         this->bits.back() = (uint64_t(1) << (this->nData % 64)) - 1;
+   }
+
+   template <class T>
+   ValidityMask::ValidityMask(const BasicRasterView<const T> &raster)
+      : nRows(raster.nRows), nCols(raster.nCols), nData(raster.nData), bits((raster.nData + 63) / 64, 0)
+   {
+      const double nodata = raster.nodata_value;
+      const long   nFull  = static_cast<long>(this->nData / 64);
+      uint64_t    *bits   = this->bits.data();
+
+      if (raster.isContiguous())
+      {
+         const T *cells = raster.data();
+#pragma omp parallel for schedule(static) if (nFull > 4096)
+         for (long w = 0; w < nFull; w++)
+         {
+            const T *block = cells + w * 64;
+            uint64_t word  = 0;
+#pragma omp simd reduction(| : word)
+            for (int j = 0; j < 64; j++)
+               word |= block[j] != nodata ? bitOf[j] : 0;
+            bits[w] = word;
+         }
+      }
+      else
+      {
+#pragma omp parallel for schedule(static) if (nFull > 4096)
+         for (long w = 0; w < nFull; w++)
+         {
+            uint64_t word = 0;
+            for (int j = 0; j < 64; j++)
+               word |= static_cast<uint64_t>(raster(w * 64 + j) != nodata) << j;
+            bits[w] = word;
+         }
+      }
+
+      for (size_t i = nFull * 64; i < this->nData; i++)
+         bits[i / 64] |= static_cast<uint64_t>(raster(i) != nodata) << (i % 64);
+   }
+
+   ValidityMask &ValidityMask::operator&=(const ValidityMask &other)
+   {
+      if (other.nRows != this->nRows || other.nCols != this->nCols)
+         throw std::invalid_argument("Validity masks must have the same size");
+
+      uint64_t       *bits   = this->bits.data();
+      const uint64_t *others = other.bits.data();
+      const long      nWords = static_cast<long>(this->bits.size());
+#pragma omp parallel for simd schedule(static) if (nWords > (1 << 16))
+      for (long w = 0; w < nWords; w++)
+         bits[w] &= others[w];
+      return *this;
+   }
+
+   size_t ValidityMask::count() const
+   {
+      const uint64_t *bits   = this->bits.data();
+      const long      nWords = static_cast<long>(this->bits.size());
+      size_t          n      = 0;
+#pragma omp parallel for schedule(static) reduction(+ : n) if (nWords > (1 << 16))
+      for (long w = 0; w < nWords; w++)
+         n += static_cast<size_t>(std::popcount(bits[w]));
+      return n;
+   }
+
+   std::vector<size_t> ValidityMask::indices() const
+   {
+      // Counts the valid cells of every block of words, then every block writes its indices from the sum of the
+      // counts before it
+      const size_t        nWords  = this->bits.size();
+      const long          nBlocks = static_cast<long>((nWords + compactionBlock - 1) / compactionBlock);
+      std::vector<size_t> offsets(nBlocks + 1, 0);
+#pragma omp parallel for schedule(static) if (nBlocks > 1)
+      for (long b = 0; b < nBlocks; b++)
+      {
+         const size_t end = std::min(nWords, (b + 1) * compactionBlock);
+         for (size_t w = b * compactionBlock; w < end; w++)
+            offsets[b + 1] += static_cast<size_t>(std::popcount(this->bits[w]));
+      }
+      for (long b = 0; b < nBlocks; b++)
+         offsets[b + 1] += offsets[b];
+
+      std::vector<size_t> inds(offsets.back());
+#pragma omp parallel for schedule(static) if (nBlocks > 1)
+      for (long b = 0; b < nBlocks; b++)
+      {
+         size_t      *out = inds.data() + offsets[b];
+         const size_t end = std::min(nWords, (b + 1) * compactionBlock);
+         for (size_t w = b * compactionBlock; w < end; w++)
+         {
+            for (uint64_t word = this->bits[w]; word != 0; word &= word - 1)
+               *out++ = w * 64 + static_cast<size_t>(std::countr_zero(word));
+         }
+      }
+      return inds;
+   }
+
+#define KILIB_RASTER_INSTANTIATE(T) template ValidityMask::ValidityMask(const BasicRasterView<const T> &raster);
+   KILIB_RASTER_FOREACH_TYPE(KILIB_RASTER_INSTANTIATE)
+#undef KILIB_RASTER_INSTANTIATE
+
+} // namespace KiLib
@@ -0,0 +1,111 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <KiLib/Raster/RasterView.hpp>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace KiLib
+{
+   /**
+    * @brief Packed bitmap of the valid (not nodata) cells of a raster, one bit per cell in flat index order: bit j of
+    * word w is the cell at flat index 64 * w + j. Masks of several rasters combine with &, and the set bits are
+    * visited with forEach or listed with indices.
+    */
+   class ValidityMask
+   {
+   public:
+      size_t nRows = 0; // Number of rows of the raster
+      size_t nCols = 0; // Number of columns of the raster
+      size_t nData = 0; // Number of cells, nRows * nCols
+
+      ValidityMask() = default;
+
+      /**
+       * @brief Mask of nRows by nCols cells, all set if valid is true and all clear otherwise
+       */
+      ValidityMask(size_t nRows, size_t nCols, bool valid);
+
+      /**
+       * @brief Mask of the cells of raster that are not nodata
+       */
+      template <class T>
+      explicit ValidityMask(const BasicRasterView<const T> &raster);
+
+      template <class T>
+      explicit ValidityMask(const BasicRasterView<T> &raster) : ValidityMask(BasicRasterView<const T>(raster))
+      {
+      }
+
+      /**
+       * @brief Keeps the cells valid in both masks. Throws std::invalid_argument if their sizes differ.
+       */
+      ValidityMask &operator&=(const ValidityMask &other);
+
+      friend ValidityMask operator&(ValidityMask lhs, const ValidityMask &rhs)
+      {
+         return lhs &= rhs;
+      }
+
+      /**
+       * @brief Whether the cell at flat index ind is valid. Doesn't do bounds checking.
+       */
+      bool test(size_t ind) const
+      {
+         return (this->bits[ind / 64] >> (ind % 64)) & 1;
+      }
+
+      /**
+       * @brief Number of valid cells
+       */
+      size_t count() const;
+
+      /**
+       * @brief Calls f(ind) with the flat index of every valid cell, in increasing order
+       */
+      template <class F>
+      void forEach(F f) const
+      {
+         for (size_t w = 0; w < this->bits.size(); w++)
+         {
+            for (uint64_t word = this->bits[w]; word != 0; word &= word - 1)
+               f(w * 64 + static_cast<size_t>(std::countr_zero(word)));
+         }
+      }
+
+      /**
+       * @brief Flat indices of the valid cells in increasing order, compacted in parallel
+       */
+      std::vector<size_t> indices() const;
+
+      /**
+       * @brief Words of the bitmap. Bits past nData are clear.
+       */
+      const std::vector<uint64_t> &words() const
+      {
+         return this->bits;
+      }
+
+   private:
+      std::vector<uint64_t> bits;
+   };
+} // namespace KiLib
@@ -0,0 +1,139 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <KiLib/Utils/MappedFile.hpp>
+#include <cstdlib>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KiLib
+{
+   MappedFile::MappedFile(const std::string &path)
+   {
+#ifdef _WIN32
+      HANDLE file = CreateFileA(
+         path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      LARGE_INTEGER size;
+      if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+      {
+         spdlog::error("Failed to open {} for reading", path);
+         exit(EXIT_FAILURE);
+      }
+      this->file   = file;
+      this->length = static_cast<size_t>(size.QuadPart);
+
+      // Empty files can not be mapped
+      if (this->length == 0)
+         return;
+
+      HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      void  *view    = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+      if (view == nullptr)
+      {
+         spdlog::error("Failed to map {} into memory", path);
+         exit(EXIT_FAILURE);
+      }
+      this->mapping = mapping;
+      this->begin   = static_cast<const std::byte *>(view);
+#else
+      const int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0)
+      {
+         spdlog::error("Failed to open {} for reading", path);
+         exit(EXIT_FAILURE);
+      }
+      this->length = static_cast<size_t>(st.st_size);
+
+      // Empty files can not be mapped
+      if (this->length == 0)
+      {
+         close(fd);
+         return;
+      }
+
+      // The mapping stays valid once the descriptor is closed
+      void *view = mmap(nullptr, this->length, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (view == MAP_FAILED)
+      {
+         spdlog::error("Failed to map {} into memory", path);
+         exit(EXIT_FAILURE);
+      }
+      this->begin = static_cast<const std::byte *>(view);
+#endif
+   }
+
+   MappedFile::~MappedFile()
+   {
+      this->unmap();
+   }
+
+   MappedFile::MappedFile(MappedFile &&other) noexcept
+   {
+      *this = std::move(other);
+   }
+
+   MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+   {
+      if (this != &other)
+      {
+         this->unmap();
+         this->begin  = std::exchange(other.begin, nullptr);
+         this->length = std::exchange(other.length, 0);
+#ifdef _WIN32
+         this->file    = std::exchange(other.file, nullptr);
+         this->mapping = std::exchange(other.mapping, nullptr);
+#endif
+      }
+      return *this;
+   }
+
+   void MappedFile::unmap()
+   {
+#ifdef _WIN32
+      if (this->begin != nullptr)
+         UnmapViewOfFile(this->begin);
+      if (this->mapping != nullptr)
+         CloseHandle(this->mapping);
+      if (this->file != nullptr)
+         CloseHandle(this->file);
+      this->file    = nullptr;
+      this->mapping = nullptr;
+#else
+      if (this->begin != nullptr)
+         munmap(const_cast<std::byte *>(this->begin), this->length);
+#endif
+      this->begin  = nullptr;
+      this->length = 0;
+   }
+} // namespace KiLib
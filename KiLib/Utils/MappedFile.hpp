@@ -0,0 +1,68 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace KiLib
+{
+   /**
+    * @brief Read-only memory mapping of a whole file. Pages are loaded on first access and shared between every
+    * process mapping the same file.
+    */
+   class MappedFile
+   {
+   public:
+      /**
+       * @brief Maps the file at path. Exits if the file can not be opened or mapped.
+       *
+       * @param path File to map
+       */
+      explicit MappedFile(const std::string &path);
+      ~MappedFile();
+
+      MappedFile(const MappedFile &)            = delete;
+      MappedFile &operator=(const MappedFile &) = delete;
+      MappedFile(MappedFile &&other) noexcept;
+      MappedFile &operator=(MappedFile &&other) noexcept;
+
+      const std::byte *data() const
+      {
+         return this->begin;
+      }
+
+      size_t size() const
+      {
+         return this->length;
+      }
+
+   private:
+      void unmap();
+
+      const std::byte *begin  = nullptr;
+      size_t           length = 0;
+#ifdef _WIN32
+      void *file    = nullptr;
+      void *mapping = nullptr;
+#endif
+   };
+} // namespace KiLib
@@ -0,0 +1,266 @@
+/**
+ *  Copyright (c) 2020-2021 CoSci LLC, USA <software@cosci-llc.com>
+ *
+ *  This file is part of KiLib-OSS.
+ *
+ *  KiLib-OSS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  KiLib-OSS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KiLib-OSS.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <KiLib/Hydrology/TopModel.hpp>
+#include <KiLib/Raster/Flow.hpp>
+#include <gtest/gtest.h>
+#include <random>
+
+namespace KiLib
+{
+   // Elevations given as a function of x (east) and y (north), rows count up from the bottom
+   template <class F>
+   static Raster MakeSurface(size_t nRows, size_t nCols, double cellsize, F f)
+   {
+      Raster dem = Raster::fromMetadata(nRows, nCols, 0, 0, cellsize, -9999, 0);
+      for (size_t r = 0; r < nRows; r++)
+         for (size_t c = 0; c < nCols; c++)
+            dem(r, c) = f(c * cellsize, r * cellsize);
+      return dem;
+   }
+
+   // Rough surface with nodata holes, dropping towards the south-west
+   static Raster MakeTerrain(size_t nRows, size_t nCols, unsigned seed)
+   {
+      std::mt19937_64                        gen(seed);
+      std::uniform_real_distribution<double> noise(0, 3);
+      Raster dem = MakeSurface(nRows, nCols, 2.0, [&](double x, double y) { return 0.3 * x + 0.2 * y + noise(gen); });
+      for (size_t i = 0; i < dem.nData; i += 37)
+         dem(i) = -9999;
+      return dem;
+   }
+
+   TEST(Flow, Directions)
+   {
+      // Drops to the east, the last column has no lower neighbour
+      Raster east = MakeSurface(5, 6, 2.0, [](double x, double) { return -x; });
+      auto   d8   = ComputeFlowDirectionD8(east);
+      auto   dinf = ComputeFlowDirectionDInf(east);
+      for (size_t r = 0; r < 5; r++)
+      {
+         for (size_t c = 0; c < 6; c++)
+         {
+            ASSERT_EQ(d8(r, c), c == 5 ? D8None : D8East);
+            ASSERT_NEAR(dinf(r, c), c == 5 ? -1 : 0, 1e-12);
+         }
+      }
+
+      // Drops to the north-east in D-infinity. D8 picks the steeper diagonal.
+      Raster northEast = MakeSurface(5, 6, 2.0, [](double x, double y) { return -x - y; });
+      ASSERT_EQ(ComputeFlowDirectionD8(northEast)(2, 2), D8NorthEast);
+      ASSERT_NEAR(ComputeFlowDirectionDInf(northEast)(2, 2), M_PI / 4, 1e-12);
+
+      // Drops mostly to the south, slightly to the west
+      Raster south = MakeSurface(5, 6, 2.0, [](double x, double y) { return 0.2 * x + y; });
+      ASSERT_EQ(ComputeFlowDirectionD8(south)(2, 2), D8South);
+      ASSERT_NEAR(ComputeFlowDirectionDInf(south)(2, 2), 3 * M_PI / 2 - std::atan(0.2), 1e-12);
+
+      // Nodata stays nodata
+      south(2, 2) = -9999;
+      ASSERT_EQ(ComputeFlowDirectionD8(south)(2, 2), D8NoData);
+      ASSERT_EQ(ComputeFlowDirectionDInf(south)(2, 2), -9999);
+   }
+
+   // Whether every valid cell has a strictly lower neighbour or drains out of the raster
+   static bool Drains(const Raster &dem)
+   {
+      for (size_t r = 0; r < dem.nRows; r++)
+      {
+         for (size_t c = 0; c < dem.nCols; c++)
+         {
+            if (dem(r, c) == dem.nodata_value)
+               continue;
+            bool drains = false;
+            for (long dr = -1; dr <= 1; dr++)
+            {
+               for (long dc = -1; dc <= 1; dc++)
+               {
+                  const long rr = r + dr, cc = c + dc;
+                  drains |= rr < 0 || rr >= (long)dem.nRows || cc < 0 || cc >= (long)dem.nCols ||
+                            dem(rr, cc) == dem.nodata_value || dem(rr, cc) < dem(r, c);
+               }
+            }
+            if (!drains)
+               return false;
+         }
+      }
+      return true;
+   }
+
+   TEST(Flow, FillDepressions)
+   {
+      // A pit in a plane fills up to its lowest neighbour
+      Raster pit = MakeSurface(5, 5, 1.0, [](double x, double) { return x; });
+      pit(2, 2)  = -5;
+      Raster flat = pit;
+      FillDepressions(flat, false);
+      ASSERT_EQ(flat(2, 2), 1);
+      ASSERT_EQ(flat(2, 3), 3);
+      FillDepressions(pit);
+      ASSERT_GT(pit(2, 2), 1);
+      ASSERT_LT(pit(2, 2), 1 + 1e-12);
+      ASSERT_TRUE(Drains(pit));
+
+      // Filling never lowers cells, leaves nodata alone and gives the same levels on tiles
+      Raster terrain = MakeTerrain(61, 57, 3);
+      Raster single  = terrain;
+      FillDepressions(single, false);
+      for (size_t tileSize : {1, 4, 16, 100})
+      {
+         Raster tiled = terrain;
+         FillDepressions(tiled, false, tileSize);
+         for (size_t i = 0; i < terrain.nData; i++)
+         {
+            ASSERT_GE(tiled(i), terrain(i));
+            ASSERT_EQ(tiled(i), single(i)) << "tile size " << tileSize << ", cell " << i;
+         }
+      }
+
+      // With epsilon every cell drains, and stays within a hair of the flat fill
+      for (size_t tileSize : {0, 1, 4, 16})
+      {
+         Raster tiled = terrain;
+         FillDepressions(tiled, true, tileSize);
+         ASSERT_TRUE(Drains(tiled)) << "tile size " << tileSize;
+         for (size_t i = 0; i < terrain.nData; i++)
+            ASSERT_NEAR(tiled(i), single(i), 1e-9) << "tile size " << tileSize << ", cell " << i;
+      }
+
+      // Integer rasters are filled flat
+      BasicRaster<int16_t> integer(terrain);
+      for (size_t i = 0; i < terrain.nData; i++)
+         if (terrain(i) != terrain.nodata_value)
+            integer(i) = static_cast<int16_t>(std::floor(terrain(i) * 10));
+      BasicRaster<int16_t> integerTiled = integer;
+      FillDepressions(integer);
+      FillDepressions(integerTiled, true, 8);
+      for (size_t i = 0; i < terrain.nData; i++)
+         ASSERT_EQ(integer(i), integerTiled(i));
+   }
+
+   TEST(Flow, AccumulationD8)
+   {
+      Raster terrain = MakeTerrain(53, 47, 1);
+      auto   dirs    = ComputeFlowDirectionD8(terrain);
+
+      // Reference: every cell adds its area along its whole flow path
+      const double area = terrain.cellsize * terrain.cellsize;
+      std::vector<double> reference(terrain.nData, 0);
+      size_t              nValid = 0;
+      for (size_t r = 0; r < terrain.nRows; r++)
+      {
+         for (size_t c = 0; c < terrain.nCols; c++)
+         {
+            if (dirs(r, c) == D8NoData)
+               continue;
+            nValid++;
+
+            long rr = r, cc = c;
+            while (true)
+            {
+               reference[rr * terrain.nCols + cc] += area;
+               const uint8_t d  = dirs(rr, cc);
+               const long    dr = (d & (D8NorthWest | D8North | D8NorthEast)) ? 1 : (d & (D8SouthWest | D8South | D8SouthEast)) ? -1 : 0;
+               const long    dc = (d & (D8NorthEast | D8East | D8SouthEast)) ? 1 : (d & (D8NorthWest | D8West | D8SouthWest)) ? -1 : 0;
+               if (d == D8None || rr + dr < 0 || rr + dr >= (long)terrain.nRows || cc + dc < 0 ||
+                   cc + dc >= (long)terrain.nCols || dirs(rr + dr, cc + dc) == D8NoData)
+                  break;
+               rr += dr;
+               cc += dc;
+            }
+         }
+      }
+
+      // A single sweep and tiles of several sizes give the reference
+      for (size_t tileSize : {0, 1, 5, 16, 100})
+      {
+         Raster acc = ComputeFlowAccumulationD8(dirs, tileSize);
+         for (size_t i = 0; i < terrain.nData; i++)
+         {
+            if (dirs(i) == D8NoData)
+               ASSERT_EQ(acc(i), -9999);
+            else
+               ASSERT_NEAR(acc(i), reference[i], 1e-9 * reference[i]) << "tile size " << tileSize << ", cell " << i;
+         }
+      }
+
+      // Eastward plane: cells accumulate the cells to their west
+      Raster east = ComputeFlowAccumulationD8(ComputeFlowDirectionD8(MakeSurface(4, 9, 2.0, [](double x, double) { return -x; })), 4);
+      for (size_t c = 0; c < 9; c++)
+         ASSERT_DOUBLE_EQ(east(2, c), (c + 1) * 4.0);
+   }
+
+   TEST(Flow, AccumulationDInf)
+   {
+      // Same as D8 along cardinal directions
+      Raster east = ComputeFlowAccumulationDInf(ComputeFlowDirectionDInf(MakeSurface(4, 9, 2.0, [](double x, double) { return -x; })));
+      for (size_t c = 0; c < 9; c++)
+         ASSERT_DOUBLE_EQ(east(2, c), (c + 1) * 4.0);
+
+      // Flow is conserved: everything ends up in cells without a lower neighbour
+      Raster terrain = MakeTerrain(41, 38, 2);
+      Raster dirs    = ComputeFlowDirectionDInf(terrain);
+      Raster acc     = ComputeFlowAccumulationDInf(dirs);
+      double total = 0, drained = 0;
+      for (size_t i = 0; i < terrain.nData; i++)
+      {
+         if (dirs(i) == -9999)
+            continue;
+         total += 4.0;
+         ASSERT_GE(acc(i), 4.0);
+         if (dirs(i) < 0)
+            drained += acc(i);
+      }
+      ASSERT_NEAR(drained, total, 1e-9 * total);
+   }
+   TEST(Flow, TopographicWetnessIndex)
+   {
+      // Eastward plane of slope 0.5: cells drain the cells to their west, a = (c + 1) * 4 / 2
+      Raster dem = MakeSurface(4, 9, 2.0, [](double x, double) { return -0.5 * x; });
+      dem(3, 8)  = -9999;
+      Raster acc = ComputeFlowAccumulationD8(ComputeFlowDirectionD8(dem));
+      Raster twi = ComputeTopographicWetnessIndex(dem, acc);
+      for (size_t c = 0; c < 8; c++)
+         ASSERT_NEAR(twi(1, c), std::log((c + 1) * 2.0 / 0.5), 1e-12);
+      ASSERT_EQ(twi(3, 8), -9999);
+
+      // Flats use the smallest slope
+      Raster flat = MakeSurface(3, 3, 2.0, [](double, double) { return 1.0; });
+      ASSERT_NEAR(ComputeTopographicWetnessIndex(flat, acc.view().subView({0, 0, 3, 3}), Raster::Horn, 0.01)(1, 1),
+                  std::log(acc(1, 1) / 2.0 / 0.01), 1e-12);
+      ASSERT_THROW(ComputeTopographicWetnessIndex(flat, acc), std::invalid_argument);
+
+      // The raster overload of TopModel matches the scalar one
+      Raster ks        = Raster::fillLike(twi, 1e-5, false);
+      Raster thickness = Raster::fillLike(twi, 2.0, false);
+      ks(0, 0)         = ks.nodata_value;
+      thickness(2, 3)  = 0.5;
+
+      Hydrology::TopModel topModel;
+      Raster              wetness = topModel.ComputeWetness(2e-6, ks, thickness, twi);
+      for (size_t i = 0; i < twi.nData; i++)
+      {
+         if (i == 0 || twi(i) == twi.nodata_value)
+            ASSERT_EQ(wetness(i), twi.nodata_value);
+         else
+            ASSERT_DOUBLE_EQ(wetness(i), topModel.ComputeWetness(2e-6, ks(i), thickness(i), twi(i)));
+      }
+   }
+} // namespace KiLib
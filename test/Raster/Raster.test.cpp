@@ -18,10 +18,16 @@
  */
 
 
+#include <KiLib/Raster/Focal.hpp>
 #include <KiLib/Raster/Raster.hpp>
+#include <KiLib/Raster/StreamIndex.hpp>
+#include <KiLib/Raster/SummedAreaTable.hpp>
+#include <KiLib/Raster/ValidityMask.hpp>
+#include <algorithm>
 #include <filesystem>
 #include <gtest/gtest.h>
 #include <numeric>
+#include <random>
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
 
@@ -80,6 +86,281 @@ namespace KiLib
       }
    }
 
+   TEST(Raster, ComputeSlopeZevenbergenThorneNoData)
+   {
+      // Random surface with scattered and clustered nodata, every cell is checked against a direct evaluation of the
+      // one sided/central differences
+      std::vector<double>                    cells(41 * 37);
+      std::mt19937_64     gen(7);
+      std::uniform_real_distribution<double> dist(0.0, 50.0);
+      for (size_t i = 0; i < cells.size(); i++)
+         cells[i] = (i % 13 == 0 || (i / 37 > 30 && i % 37 < 5)) ? -9999 : dist(gen);
+      Raster dem(RasterView(cells.data(), 41, 37, 37, 0, 0, 2.0, -9999));
+
+      auto reference = [&](int r, int c)
+      {
+         auto valid = [&](int ri, int ci)
+         { return ri >= 0 && ri < (int)dem.nRows && ci >= 0 && ci < (int)dem.nCols && dem(ri, ci) != -9999; };
+
+         const int    r1 = valid(r - 1, c) ? r - 1 : r;
+         const int    r2 = valid(r + 1, c) ? r + 1 : r;
+         const int    c1 = valid(r, c - 1) ? c - 1 : c;
+         const int    c2 = valid(r, c + 1) ? c + 1 : c;
+         // A cell without either neighbour divides 0 by half a cell
+         const double g  = (dem(r, c2) - dem(r, c1)) / (std::max(c2 - c1, 1) * dem.cellsize / (c2 == c1 ? 2 : 1));
+         const double h  = (dem(r1, c) - dem(r2, c)) / (std::max(r2 - r1, 1) * dem.cellsize / (r2 == r1 ? 2 : 1));
+         return std::sqrt(g * g + h * h);
+      };
+
+      Raster slope = dem.ComputeSlope(Raster::ZevenbergenThorne);
+      for (int r = 0; r < (int)dem.nRows; r++)
+      {
+         for (int c = 0; c < (int)dem.nCols; c++)
+         {
+            if (dem(r, c) == -9999)
+               ASSERT_EQ(slope(r, c), -9999);
+            else
+               ASSERT_NEAR(slope(r, c), reference(r, c), 1e-12);
+         }
+      }
+
+      Raster slopeF = BasicRaster<float>(dem).ComputeSlope(BasicRaster<float>::ZevenbergenThorne);
+      for (size_t i = 0; i < dem.nData; i++)
+         ASSERT_NEAR(slopeF(i), slope(i), 1e-4 * (1 + std::abs(slope(i))));
+   }
+
+   TEST(Raster, ComputeSlopeMethods)
+   {
+      // Same kind of surface as above, missing neighbours take the value of the centre cell
+      std::vector<double>                    cells(41 * 37);
+      std::mt19937_64                        gen(11);
+      std::uniform_real_distribution<double> dist(0.0, 50.0);
+      for (size_t i = 0; i < cells.size(); i++)
+         cells[i] = (i % 11 == 0 || (i / 37 < 6 && i % 37 > 30)) ? -9999 : dist(gen);
+      Raster dem(RasterView(cells.data(), 41, 37, 37, 0, 0, 2.0, -9999));
+
+      Raster horn        = dem.ComputeSlope(Raster::Horn);
+      Raster evansYoung  = dem.ComputeSlope(Raster::EvansYoung);
+      Raster maxDownhill = dem.ComputeSlope(Raster::MaxDownhill);
+
+      const double cs = dem.cellsize;
+      for (int r = 0; r < (int)dem.nRows; r++)
+      {
+         for (int c = 0; c < (int)dem.nCols; c++)
+         {
+            if (dem(r, c) == -9999)
+            {
+               ASSERT_EQ(horn(r, c), -9999);
+               ASSERT_EQ(evansYoung(r, c), -9999);
+               ASSERT_EQ(maxDownhill(r, c), -9999);
+               continue;
+            }
+
+            auto z = [&](int dr, int dc)
+            {
+               const int ri = r + dr, ci = c + dc;
+               if (ri < 0 || ri >= (int)dem.nRows || ci < 0 || ci >= (int)dem.nCols || dem(ri, ci) == -9999)
+                  return dem(r, c);
+               return dem(ri, ci);
+            };
+
+            // Row + 1 is north
+            double dx = ((z(1, 1) + 2 * z(0, 1) + z(-1, 1)) - (z(1, -1) + 2 * z(0, -1) + z(-1, -1))) / (8 * cs);
+            double dy = ((z(1, -1) + 2 * z(1, 0) + z(1, 1)) - (z(-1, -1) + 2 * z(-1, 0) + z(-1, 1))) / (8 * cs);
+            ASSERT_NEAR(horn(r, c), std::sqrt(dx * dx + dy * dy), 1e-12);
+
+            dx = ((z(1, 1) + z(0, 1) + z(-1, 1)) - (z(1, -1) + z(0, -1) + z(-1, -1))) / (6 * cs);
+            dy = ((z(1, -1) + z(1, 0) + z(1, 1)) - (z(-1, -1) + z(-1, 0) + z(-1, 1))) / (6 * cs);
+            ASSERT_NEAR(evansYoung(r, c), std::sqrt(dx * dx + dy * dy), 1e-12);
+
+            double drop = 0;
+            for (int dr = -1; dr <= 1; dr++)
+               for (int dc = -1; dc <= 1; dc++)
+                  if (dr != 0 || dc != 0)
+                     drop = std::max(drop, (dem(r, c) - z(dr, dc)) / (cs * std::sqrt(double(dr * dr + dc * dc))));
+            ASSERT_NEAR(maxDownhill(r, c), drop, 1e-12);
+         }
+      }
+
+      // Integer rasters go through the same kernels and keep fractional slopes
+      BasicRaster<int32_t> demI(dem);
+      for (auto method : {Raster::ZevenbergenThorne, Raster::Horn, Raster::EvansYoung, Raster::MaxDownhill})
+      {
+         const Raster slopeI = BasicRaster<int32_t>::ComputeSlope(demI, BasicRaster<int32_t>::SlopeMethod(method));
+         const Raster slopeD = Raster(demI).ComputeSlope(method);
+         ASSERT_EQ(slopeI.data, slopeD.data);
+         ASSERT_TRUE(std::any_of(
+            slopeI.data.begin(), slopeI.data.end(), [](double v) { return v > 0 && v != std::floor(v); }));
+      }
+   }
+
+   TEST(Raster, ComputeTerrainDerivatives)
+   {
+      // Surfaces given as functions of x (east) and y (north), rows count up from the bottom
+      const size_t nRows = 9, nCols = 11;
+      const double cs    = 2.0;
+      auto         make  = [&](auto f)
+      {
+         Raster dem(RasterView(std::vector<double>(nRows * nCols).data(), nRows, nCols, nCols, 0, 0, cs, -9999));
+         for (size_t r = 0; r < nRows; r++)
+            for (size_t c = 0; c < nCols; c++)
+               dem(r, c) = f(c * cs, r * cs);
+         return dem;
+      };
+
+      // Planes facing north, east, south and west
+      const std::vector<std::pair<std::function<double(double, double)>, double>> planes{
+         {[](double, double y) { return -y; }, 0},
+         {[](double x, double) { return -x; }, 90},
+         {[](double, double y) { return y; }, 180},
+         {[](double x, double) { return x; }, 270},
+      };
+      for (const auto &[f, aspect] : planes)
+      {
+         auto d = make(f).ComputeTerrainDerivatives(Raster::Aspect);
+         ASSERT_NEAR(d.aspect(4, 5), aspect, 1e-9);
+      }
+      ASSERT_EQ(make([](double, double) { return 1.0; }).ComputeTerrainDerivatives(Raster::Aspect).aspect(4, 5), -1);
+
+      // Paraboloid z = a (x^2 + y^2) centred on column 5: on the x axis the profile curvature is -2a, the plan
+      // curvature 2a and the total curvature -4a
+      const double a   = 0.25;
+      Raster       dem = make([&](double x, double y) { return a * ((x - 10) * (x - 10) + (y - 8) * (y - 8)); });
+      auto         all = dem.ComputeTerrainDerivatives(
+         Raster::Slope | Raster::Aspect | Raster::ProfileCurvature | Raster::PlanCurvature | Raster::TotalCurvature);
+      ASSERT_NEAR(all.profileCurvature(4, 7), -2 * a, 1e-12);
+      ASSERT_NEAR(all.planCurvature(4, 7), 2 * a, 1e-12);
+      ASSERT_NEAR(all.totalCurvature(4, 7), -4 * a, 1e-12);
+      ASSERT_NEAR(all.aspect(4, 7), 270, 1e-9); // Rises to the east
+      ASSERT_NEAR(all.slope(4, 7), 2 * a * 4, 1e-12);
+
+      // Slopes match ComputeSlopeZevenbergenThorne exactly, including next to nodata. Unrequested derivatives stay
+      // empty.
+      std::vector<double>                    cells(41 * 37);
+      std::mt19937_64                        gen(5);
+      std::uniform_real_distribution<double> dist(0.0, 50.0);
+      for (size_t i = 0; i < cells.size(); i++)
+         cells[i] = i % 17 == 0 ? -9999 : dist(gen);
+      RasterView noisy(cells.data(), 41, 37, 37, 0, 0, 2.0, -9999);
+
+      auto some = Raster::ComputeTerrainDerivatives(noisy, Raster::Slope | Raster::PlanCurvature);
+      ASSERT_EQ(some.slope.data, Raster::ComputeSlopeZevenbergenThorne(noisy).data);
+      ASSERT_EQ(some.aspect.nData, 0);
+      ASSERT_EQ(some.profileCurvature.nData, 0);
+      ASSERT_EQ(some.totalCurvature.nData, 0);
+      ASSERT_EQ(some.planCurvature.nData, noisy.nData);
+      ASSERT_EQ(some.planCurvature(0), -9999);
+
+      // Integer elevations give the derivatives of the same values stored as doubles, including aspects beyond the
+      // range of the cell type, the -1 of flats and negative curvatures
+      BasicRaster<uint8_t> bytes = BasicRaster<uint8_t>::fromMetadata(41, 37, 0, 0, 2.0, 255);
+      for (size_t i = 0; i < bytes.nData; i++)
+         bytes(i) = i % 17 == 0 ? 255 : (i / 37 < 5 ? 10 : static_cast<uint8_t>(dist(gen)));
+      const unsigned every =
+         Raster::Slope | Raster::Aspect | Raster::ProfileCurvature | Raster::PlanCurvature | Raster::TotalCurvature;
+      auto fromBytes   = BasicRaster<uint8_t>::ComputeTerrainDerivatives(bytes, every);
+      auto fromDoubles = Raster(bytes).ComputeTerrainDerivatives(every);
+      ASSERT_EQ(fromBytes.slope.data, fromDoubles.slope.data);
+      ASSERT_EQ(fromBytes.aspect.data, fromDoubles.aspect.data);
+      ASSERT_EQ(fromBytes.profileCurvature.data, fromDoubles.profileCurvature.data);
+      ASSERT_EQ(fromBytes.planCurvature.data, fromDoubles.planCurvature.data);
+      ASSERT_EQ(fromBytes.totalCurvature.data, fromDoubles.totalCurvature.data);
+      const auto &aspects = fromBytes.aspect.data;
+      ASSERT_TRUE(std::any_of(aspects.begin(), aspects.end(), [](double v) { return v > 255; }));
+      ASSERT_TRUE(std::count(aspects.begin(), aspects.end(), -1.0) > 0);
+      const auto &total = fromBytes.totalCurvature.data;
+      ASSERT_TRUE(std::any_of(total.begin(), total.end(), [](double v) { return v < 0; }));
+   }
+
+   // Mean and number of the valid cells of a 5x5 window
+   struct _FocalMeanCount
+   {
+      static constexpr int radius = 2;
+
+      template <class W>
+      std::array<double, 2> operator()(const W &w) const
+      {
+         double sum = 0, count = 0;
+         for (int dr = -radius; dr <= radius; dr++)
+         {
+            for (int dc = -radius; dc <= radius; dc++)
+            {
+               sum += w.valid(dr, dc) ? w(dr, dc) : 0;
+               count += w.valid(dr, dc) ? 1 : 0;
+            }
+         }
+         return {sum / count, count};
+      }
+   };
+
+   struct _FocalMean
+   {
+      static constexpr int radius = 2;
+
+      template <class W>
+      double operator()(const W &w) const
+      {
+         return _FocalMeanCount()(w)[0];
+      }
+   };
+
+   TEST(Raster, FocalApply)
+   {
+      // Spans several tiles in both directions
+      std::vector<double>                    cells(70 * 2100);
+      std::mt19937_64                        gen(3);
+      std::uniform_real_distribution<double> dist(0.0, 50.0);
+      for (size_t i = 0; i < cells.size(); i++)
+         cells[i] = (i % 101 == 0 || (i / 2100 > 60 && i % 2100 > 2040)) ? -9999 : dist(gen);
+      RasterView dem(cells.data(), 70, 2100, 2100, 0, 0, 1.0, -9999);
+
+      Raster mean  = Raster::emptyLike(dem);
+      Raster count = Raster::emptyLike(dem);
+      FocalApply(dem, _FocalMeanCount{}, std::array{mean.view(), count.view()});
+
+      for (long r = 0; r < (long)dem.nRows; r++)
+      {
+         for (long c = 0; c < (long)dem.nCols; c++)
+         {
+            if (dem(r, c) == -9999)
+            {
+               ASSERT_EQ(mean(r, c), -9999);
+               ASSERT_EQ(count(r, c), -9999);
+               continue;
+            }
+
+            double sum = 0, n = 0;
+            for (long ri = std::max(r - 2, 0l); ri <= std::min(r + 2, (long)dem.nRows - 1); ri++)
+            {
+               for (long ci = std::max(c - 2, 0l); ci <= std::min(c + 2, (long)dem.nCols - 1); ci++)
+               {
+                  if (dem(ri, ci) != -9999)
+                  {
+                     sum += dem(ri, ci);
+                     n++;
+                  }
+               }
+            }
+            ASSERT_NEAR(mean(r, c), sum / n, 1e-9);
+            ASSERT_EQ(count(r, c), n);
+         }
+      }
+
+      // Single outputs can have another cell type, results for empty views are dropped
+      BasicRaster<float> meanF(mean);
+      FocalApply(dem, _FocalMean{}, meanF.view());
+      for (size_t i = 0; i < dem.nData; i++)
+         ASSERT_NEAR(meanF(i), mean(i), 1e-4 * (1 + std::abs(mean(i))));
+
+      Raster countOnly = Raster::emptyLike(dem);
+      FocalApply(dem, _FocalMeanCount{}, std::array{BasicRasterView<double>(), countOnly.view()});
+      ASSERT_EQ(countOnly.data, count.data);
+
+      // Outputs must match the input size
+      Raster small = Raster::emptyLike(dem.subView({0, 0, 10, 10}));
+      ASSERT_THROW(FocalApply(dem, _FocalMean{}, small.view()), std::invalid_argument);
+   }
+
    TEST(Raster, getCellPos)
    {
       auto                     cwd  = fs::current_path();
@@ -132,6 +413,61 @@ namespace KiLib
       ASSERT_DOUBLE_EQ(z3, p3.z);
    }
 
+   TEST(Raster, getInterpBilinearBatch)
+   {
+      // Enough positions for the parallel path, including some past the top and right edges
+      std::vector<double> cells(23 * 31);
+      std::iota(cells.begin(), cells.end(), 0.0);
+      for (double &v : cells)
+         v = std::sin(v);
+      BasicRasterView<const double> view(cells.data(), 23, 31, 31, 100, 200, 2, -9999);
+
+      std::mt19937_64                        gen(3);
+      std::uniform_real_distribution<double> dx(100, 100 + 2 * 31 + 3);
+      std::uniform_real_distribution<double> dy(200, 200 + 2 * 23 + 3);
+      const size_t                           n = 40000;
+      std::vector<double>                    x(n), y(n), z(n), zSkip(n);
+      for (size_t i = 0; i < n; i++)
+      {
+         x[i] = dx(gen);
+         y[i] = dy(gen);
+      }
+      view.getInterpBilinear(x, y, z);
+      view.getInterpBilinear(x, y, zSkip, true);
+      for (size_t i = 0; i < n; i++)
+      {
+         ASSERT_EQ(z[i], view.getInterpBilinear(Vec3{x[i], y[i], 0}));
+         ASSERT_EQ(zSkip[i], z[i]);
+      }
+
+      // Left of and below the view both overloads use the edge values, NaN positions give NaN
+      std::vector<double> ex{95, 101, 95, std::nan("")}, ey{203, 190, 190, 201}, ez(4);
+      view.getInterpBilinear(ex, ey, ez);
+      ASSERT_DOUBLE_EQ(ez[0], (view(1, 0) + view(2, 0)) / 2);
+      ASSERT_DOUBLE_EQ(ez[1], (view(0, 0) + view(0, 1)) / 2);
+      ASSERT_EQ(ez[2], view(0, 0));
+      ASSERT_TRUE(std::isnan(ez[3]));
+      for (size_t i = 0; i < 3; i++)
+         ASSERT_EQ(ez[i], view.getInterpBilinear(Vec3{ex[i], ey[i], 0}));
+      ASSERT_TRUE(std::isnan(view.getInterpBilinear(Vec3{ex[3], ey[3], 0})));
+
+      // Nodata corners are left out and the remaining weights rescaled
+      Raster r = Raster::fromMetadata(3, 3, 0, 0, 1, -9999, 4);
+      r(1, 1)  = r.nodata_value;
+      r(0, 1)  = 1;
+      r(2, 2)  = r.nodata_value;
+      r(1, 2)  = r.nodata_value;
+      r(2, 1)  = r.nodata_value;
+      std::vector<double> rx{0.5, 1.5, 1.25, 0.5}, ry{0.5, 1.5, 0.5, 1}, rz(4);
+      r.getInterpBilinear(rx, ry, rz, true);
+      ASSERT_DOUBLE_EQ(rz[0], (4 + 1 + 4) / 3.0);
+      ASSERT_EQ(rz[1], r.nodata_value);
+      ASSERT_DOUBLE_EQ(rz[2], (1 * 0.375 + 4 * 0.125) / 0.5);
+      ASSERT_DOUBLE_EQ(rz[3], 4);
+
+      ASSERT_THROW(r.getInterpBilinear(rx, ry, std::span<double>(rz).first(3)), std::invalid_argument);
+   }
+
 /*   TEST(Raster, GetCoordMinDistance)
    {
       auto cwd  = fs::current_path();
@@ -221,6 +557,121 @@ namespace KiLib
       ASSERT_DOUBLE_EQ(rasterizedTrunc(5, 1), 2.0 / 3.0);
       ASSERT_DOUBLE_EQ(rasterizedTrunc(1, 1), 1.0);
       ASSERT_DOUBLE_EQ(rasterizedTrunc(0, 0), 1.0);
+
+      // Pointers to members, and enough objects for threads to scatter into buffers of their own
+      std::mt19937_64                        gen(3);
+      std::uniform_real_distribution<double> x(-1, 31), y(-1, 41), attr(0, 1);
+      Raster ref = Raster::fromMetadata(40, 30, 0, 0, 1.0, -9999, 0);
+      ref(7, 7)  = ref.nodata_value;
+      std::vector<TestClass> many;
+      for (size_t i = 0; i < 100000; i++)
+         many.emplace_back(KiLib::Vec3(x(gen), y(gen), 0), attr(gen));
+
+      std::vector<double> sums(ref.nData, 0), counts(ref.nData, 0);
+      for (const auto &obj : many)
+      {
+         sums[ref.getNearestCell(obj.pos)] += obj.safetyFactor;
+         counts[ref.getNearestCell(obj.pos)]++;
+      }
+      for (int width : {-1, 0, 1, 3})
+      {
+         KiLib::Raster rasterized =
+            KiLib::Raster::Rasterize(ref, many, &TestClass::pos, &TestClass::safetyFactor, width);
+         for (long r = 0; r < (long)ref.nRows; r++)
+         {
+            for (long c = 0; c < (long)ref.nCols; c++)
+            {
+               double sum = 0, count = 0;
+               for (long rr = std::max(r - width, 0L); rr <= std::min(r + width, (long)ref.nRows - 1); rr++)
+               {
+                  for (long cc = std::max(c - width, 0L); cc <= std::min(c + width, (long)ref.nCols - 1); cc++)
+                  {
+                     sum += sums[ref.flattenIndex(rr, cc)];
+                     count += counts[ref.flattenIndex(rr, cc)];
+                  }
+               }
+               if (ref(r, c) == ref.nodata_value)
+                  ASSERT_EQ(rasterized(r, c), ref.nodata_value);
+               else
+                  ASSERT_NEAR(rasterized(r, c), count ? sum / count : 0, 1e-12) << r << " " << c << " " << width;
+            }
+         }
+
+         // Means are not truncated to the cell type of the reference
+         BasicRaster<uint8_t> refBytes = BasicRaster<uint8_t>::fromMetadata(40, 30, 0, 0, 1.0, 255, 1);
+         refBytes(7, 7)                = refBytes.nodata_value;
+         Raster fromBytes =
+            BasicRaster<uint8_t>::Rasterize(refBytes, many, &TestClass::pos, &TestClass::safetyFactor, width);
+         ASSERT_EQ(fromBytes(7, 7), 255);
+         fromBytes(7, 7) = ref.nodata_value;
+         ASSERT_EQ(fromBytes.data, rasterized.data);
+      }
+
+      // Every statistic in one scan, against the attributes of each cell
+      const auto stats = KiLib::Raster::RasterizeStatistics(
+         ref, many, &TestClass::pos, [](const TestClass &obj) { return 1000 + obj.safetyFactor; },
+         Raster::Mean | Raster::Max | Raster::Count | Raster::Variance, {0.0, 0.25, 0.5, 1.0});
+      ASSERT_TRUE(stats.sum.data.empty());
+      ASSERT_TRUE(stats.min.data.empty());
+      ASSERT_EQ(stats.quantiles.size(), 4);
+
+      std::vector<std::vector<double>> cells(ref.nData);
+      for (const auto &obj : many)
+         cells[ref.getNearestCell(obj.pos)].push_back(1000 + obj.safetyFactor);
+      for (size_t i = 0; i < ref.nData; i++)
+      {
+         auto &v = cells[i];
+         if (ref(i) == ref.nodata_value)
+         {
+            ASSERT_EQ(stats.mean(i), ref.nodata_value);
+            ASSERT_EQ(stats.count(i), ref.nodata_value);
+            ASSERT_EQ(stats.quantiles[0](i), ref.nodata_value);
+            continue;
+         }
+
+         ASSERT_EQ(stats.count(i), v.size());
+         if (v.empty())
+         {
+            ASSERT_EQ(stats.mean(i), 0);
+            ASSERT_EQ(stats.max(i), ref.nodata_value);
+            ASSERT_EQ(stats.variance(i), ref.nodata_value);
+            ASSERT_EQ(stats.quantiles[2](i), ref.nodata_value);
+            continue;
+         }
+
+         const double mean = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+         double       var  = 0;
+         for (double x : v)
+            var += (x - mean) * (x - mean) / v.size();
+         std::sort(v.begin(), v.end());
+         ASSERT_NEAR(stats.mean(i), mean, 1e-9);
+         ASSERT_EQ(stats.max(i), v.back());
+         ASSERT_NEAR(stats.variance(i), var, 1e-9);
+         ASSERT_EQ(stats.quantiles[0](i), v.front());
+         ASSERT_EQ(stats.quantiles[3](i), v.back());
+         const double pos = 0.25 * (v.size() - 1);
+         const size_t lo  = (size_t)pos;
+         ASSERT_NEAR(stats.quantiles[1](i), v[lo] + (pos - lo) * (v[std::min(lo + 1, v.size() - 1)] - v[lo]), 1e-9);
+         ASSERT_NEAR(
+            stats.quantiles[2](i), v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2, 1e-9);
+      }
+      ASSERT_THROW(
+         KiLib::Raster::RasterizeStatistics(ref, many, &TestClass::pos, &TestClass::safetyFactor, Raster::Mean, {1.5}),
+         std::invalid_argument);
+      // Counts, sums and variances are not limited to the cell type of the reference
+      BasicRaster<uint8_t>   bytes = BasicRaster<uint8_t>::fromMetadata(2, 2, 0, 0, 1.0, 255);
+      std::vector<TestClass> crowd;
+      for (size_t i = 0; i < 1000; i++)
+         crowd.emplace_back(KiLib::Vec3(0.5, 0.5, 0), (i % 2) * 0.5);
+      const auto crowded = BasicRaster<uint8_t>::RasterizeStatistics(
+         bytes, crowd, &TestClass::pos, &TestClass::safetyFactor,
+         Raster::Mean | Raster::Sum | Raster::Count | Raster::Variance, {0.5});
+      ASSERT_EQ(crowded.count(0, 0), 1000);
+      ASSERT_DOUBLE_EQ(crowded.sum(0, 0), 250);
+      ASSERT_DOUBLE_EQ(crowded.mean(0, 0), 0.25);
+      ASSERT_DOUBLE_EQ(crowded.variance(0, 0), 0.0625);
+      ASSERT_DOUBLE_EQ(crowded.quantiles[0](0, 0), 0.25);
+      ASSERT_EQ(crowded.count(1, 1), 0);
    }
 
 
@@ -240,6 +691,194 @@ namespace KiLib
       ASSERT_DOUBLE_EQ(avg3, 13.5);
    }
 
+   TEST(Raster, SummedAreaTable)
+   {
+      auto   path = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/7x3_NODATA.dem");
+      Raster small(path.string());
+      SummedAreaTable smallTable(small);
+      ASSERT_DOUBLE_EQ(smallTable.GetAverage(0, 4.0), 6.0);
+      ASSERT_DOUBLE_EQ(smallTable.GetAverage(4, 1.0), 4.0);
+      ASSERT_DOUBLE_EQ(smallTable.GetAverage(14, 2.0), 13.5);
+      ASSERT_THROW(smallTable.GetAverage(small.nData, 1.0), std::out_of_range);
+
+      // Random elevations far from 0 with nodata holes
+      std::mt19937_64                        gen(7);
+      std::uniform_real_distribution<double> value(1000, 1100);
+      Raster dem = Raster::fromMetadata(47, 61, 0, 0, 2.5, -9999, 0);
+      for (size_t i = 0; i < dem.nData; i++)
+         dem(i) = i % 11 == 3 ? dem.nodata_value : value(gen);
+      const SummedAreaTable table(dem);
+
+      for (double radius : {0.0, 2.5, 4.9, 7.5, 11.0, 30.0, 200.0})
+      {
+         for (size_t ind = 0; ind < dem.nData; ind += 13)
+         {
+            ASSERT_NEAR(table.GetAverage(ind, radius), dem.GetAverage(ind, radius), 1e-9) << ind << " " << radius;
+
+            // Square windows hold every valid cell of the rows and columns within the radius
+            const long r = ind / dem.nCols, c = ind % dem.nCols, extent = std::floor(radius / dem.cellsize);
+            double     sum = 0, count = 0;
+            for (long rr = std::max(r - extent, 0L); rr <= std::min(r + extent, (long)dem.nRows - 1); rr++)
+            {
+               for (long cc = std::max(c - extent, 0L); cc <= std::min(c + extent, (long)dem.nCols - 1); cc++)
+               {
+                  if (dem(rr, cc) != dem.nodata_value)
+                  {
+                     sum += dem(rr, cc);
+                     count++;
+                  }
+               }
+            }
+            ASSERT_NEAR(table.GetSquareAverage(ind, radius), count ? sum / count : 0, 1e-9);
+         }
+      }
+
+      ASSERT_NEAR(table.GetWindowAverage({}), std::accumulate(dem.data.begin(), dem.data.end(), 0.0, [&](double s, double v)
+                                                               { return v == dem.nodata_value ? s : s + v; }) /
+                                                  (dem.nData - (dem.nData + 7) / 11),
+                  1e-9);
+      ASSERT_EQ(table.GetWindowAverage({3, 3, 1, 1}), dem(3, 3) == dem.nodata_value ? 0 : dem(3, 3));
+
+      double windowSum = 0, sum = 0;
+      size_t windowCount = 0, count = 0;
+      table.GetWindowSum({2, 4, 3, 5}, windowSum, windowCount);
+      for (size_t r = 2; r < 5; r++)
+      {
+         for (size_t c = 4; c < 9; c++)
+         {
+            if (dem(r, c) != dem.nodata_value)
+            {
+               sum += dem(r, c);
+               count++;
+            }
+         }
+      }
+      ASSERT_EQ(windowCount, count);
+      ASSERT_NEAR(windowSum, sum, 1e-9);
+   }
+
+   TEST(Raster, ComputeAverage)
+   {
+      std::mt19937_64                        gen(11);
+      std::uniform_real_distribution<double> value(-50, 50);
+      Raster dem = Raster::fromMetadata(38, 45, 0, 0, 3.0, -9999, 0);
+      for (size_t i = 0; i < dem.nData; i++)
+         dem(i) = i % 7 == 2 ? dem.nodata_value : value(gen);
+
+      for (double radius : {-1.0, 0.0, 3.0, 4.5, 9.0, 20.0, 500.0})
+      {
+         Raster mean = dem.ComputeAverage(radius);
+         for (size_t i = 0; i < dem.nData; i++)
+         {
+            if (dem(i) == dem.nodata_value)
+               ASSERT_EQ(mean(i), dem.nodata_value);
+            else
+               ASSERT_NEAR(mean(i), dem.GetAverage(i, radius), 1e-9) << i << " " << radius;
+         }
+      }
+
+      BasicRaster<int16_t> integer(dem);
+      BasicRaster<double>  integerMean = integer.ComputeAverage(6.0);
+      for (size_t i = 0; i < dem.nData; i++)
+      {
+         if (integer(i) != integer.nodata_value)
+         {
+            ASSERT_NEAR(integerMean(i), integer.GetAverage(i, 6.0), 1e-9);
+         }
+      }
+   }
+
+   TEST(Raster, StreamIndex)
+   {
+      // Sparse streams over integer elevations, searched from cell centres and corners so distances and runouts tie
+      std::mt19937_64                        gen(5);
+      std::uniform_int_distribution<int>     height(0, 20);
+      std::uniform_real_distribution<double> accumulation(0, 100);
+      Raster streams = Raster::fromMetadata(53, 41, 100, 200, 2.0, -9999, 0);
+      Raster elev    = Raster::fillLike(streams, 0, false);
+      for (size_t i = 0; i < streams.nData; i++)
+      {
+         streams(i) = i % 13 == 5 ? streams.nodata_value : accumulation(gen);
+         elev(i)    = height(gen);
+      }
+
+      const double threshold = 85;
+      for (size_t blockSize : {1, 4, 16, 100})
+      {
+         const StreamIndex index(streams, threshold, blockSize);
+         ASSERT_EQ(index.size(), std::count_if(streams.data.begin(), streams.data.end(), [&](double v)
+                                               { return v != streams.nodata_value && v >= threshold; }));
+
+         for (double radius : {0.0, 2.0, 5.0, 9.0, 30.0, 500.0})
+         {
+            for (size_t ind = 0; ind < streams.nData; ind += 7)
+            {
+               const auto  [r, c] = streams.GetRowCol(ind);
+               KiLib::Vec3 inPos(streams.xllcorner + (c + (ind % 2 ? 0.5 : 0.0)) * streams.cellsize,
+                                 streams.yllcorner + (r + 0.5) * streams.cellsize, 10.0 + ind % 5);
+
+               const auto expected = streams.GetCoordMinDistance(ind, inPos, elev, radius, threshold);
+               const auto found    = index.GetCoordMinDistance(ind, inPos, elev, radius);
+               ASSERT_EQ(found.has_value(), expected.has_value()) << ind << " " << radius;
+               if (found)
+               {
+                  ASSERT_EQ(found->x, expected->x) << ind << " " << radius;
+                  ASSERT_EQ(found->y, expected->y) << ind << " " << radius;
+                  ASSERT_EQ(found->z, 0.0);
+               }
+
+               double     expectedProb = -1, foundProb = -1;
+               const auto expectedCell =
+                  streams.FindClosestStreamCell(ind, inPos, elev, radius, threshold, 1.5, 0.6, expectedProb);
+               const auto foundCell = index.FindClosestStreamCell(ind, inPos, elev, radius, 1.5, 0.6, foundProb);
+               ASSERT_EQ(foundCell.has_value(), expectedCell.has_value()) << ind << " " << radius;
+               ASSERT_EQ(foundProb, expectedProb);
+               if (foundCell)
+               {
+                  ASSERT_EQ(foundCell->x, expectedCell->x) << ind << " " << radius;
+                  ASSERT_EQ(foundCell->y, expectedCell->y) << ind << " " << radius;
+               }
+            }
+         }
+      }
+
+      // Batches agree with single queries, except which of several cells rounding to the same probability is returned
+      const StreamIndex        index(streams, threshold);
+      std::vector<size_t>      inds;
+      std::vector<KiLib::Vec3> inPos;
+      for (size_t i = 0; i < 3000; i++)
+      {
+         const size_t ind = (i * 7919) % streams.nData;
+         inds.push_back(ind);
+         inPos.push_back(streams.getCellPos(ind) + KiLib::Vec3(0.3 * (i % 5), 0.2 * (i % 7), 6.0 + i % 9 - elev(ind)));
+      }
+      std::vector<KiLib::Vec3> pos(inds.size());
+      std::vector<double>      prob(inds.size(), -1);
+      const size_t             nFound = index.FindClosestStreamCells(inds, inPos, elev, 9.0, 1.5, 0.6, pos, prob);
+      size_t                   nExpected = 0;
+      for (size_t i = 0; i < inds.size(); i++)
+      {
+         double     expectedProb = 0;
+         const auto expected     = index.FindClosestStreamCell(inds[i], inPos[i], elev, 9.0, 1.5, 0.6, expectedProb);
+         ASSERT_EQ(prob[i], expected ? expectedProb : 0.0) << i;
+         nExpected += expected.has_value();
+         if (expected && expectedProb < 0.99)
+         {
+            ASSERT_EQ(pos[i].x, expected->x) << i;
+            ASSERT_EQ(pos[i].y, expected->y) << i;
+         }
+      }
+      ASSERT_EQ(nFound, nExpected);
+      ASSERT_GT(nFound, 0);
+      ASSERT_LT(nFound, inds.size());
+      ASSERT_THROW(index.FindClosestStreamCells(inds, inPos, elev, 9.0, 1.5, 0.6, pos, {}), std::invalid_argument);
+      ASSERT_THROW(index.FindClosestStreamCells(inds, inPos, elev, 9.0, 0.0, 0.6, pos, prob), std::invalid_argument);
+
+      ASSERT_THROW(index.GetCoordMinDistance(streams.nData, {}, elev, 5.0), std::out_of_range);
+      Raster small = Raster::fromMetadata(5, 5, 0, 0, 2.0, -9999, 0);
+      ASSERT_THROW(index.GetCoordMinDistance(0, {}, small, 5.0), std::invalid_argument);
+   }
+
    TEST(Raster, fillLike)
    {
       auto   cwd  = fs::current_path();
@@ -268,6 +907,104 @@ namespace KiLib
       ASSERT_EQ(sumFull, 0);
    }
 
+   TEST(Raster, RasterView)
+   {
+      auto   path = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/7x7.dem");
+      Raster dem(path.string());
+
+      // External buffer with padding at the end of every row
+      const size_t        stride = dem.nCols + 3;
+      std::vector<double> buffer(dem.nRows * stride, -1.0);
+      for (size_t r = 0; r < dem.nRows; r++)
+         std::copy_n(&dem(r, 0), dem.nCols, &buffer[r * stride]);
+
+      RasterView view(
+         buffer.data(), dem.nRows, dem.nCols, stride, dem.xllcorner, dem.yllcorner, dem.cellsize, dem.nodata_value);
+
+      ASSERT_FALSE(view.isContiguous());
+      ASSERT_EQ(view.nData, dem.nData);
+      ASSERT_DOUBLE_EQ(view.width, dem.width);
+      for (size_t i = 0; i < dem.nData; i++)
+         ASSERT_EQ(view(i), dem(i));
+      ASSERT_EQ(view.at(2, 5), dem.at(2, 5));
+      ASSERT_THROW(view.at(0, dem.nCols), std::out_of_range);
+      ASSERT_THROW(view.at(dem.nData), std::out_of_range);
+
+      const Vec3 pos{dem.xllcorner + 2.3 * dem.cellsize, dem.yllcorner + 4.6 * dem.cellsize, 0};
+      ASSERT_DOUBLE_EQ(view(pos), dem(pos));
+      ASSERT_DOUBLE_EQ(view.GetAverage(24, 2 * dem.cellsize), dem.GetAverage(24, 2 * dem.cellsize));
+      ASSERT_EQ(Raster::ComputeSlopeZevenbergenThorne(view).data, dem.ComputeSlope(Raster::ZevenbergenThorne).data);
+      ASSERT_EQ(Raster(view).data, dem.data);
+
+      // Writes through a view land in the raster
+      BasicRasterView<double> writable = dem.view(RasterWindow{1, 2, 3, 4});
+      ASSERT_EQ(writable.stride, dem.nCols);
+      ASSERT_DOUBLE_EQ(writable.xllcorner, dem.xllcorner + 2 * dem.cellsize);
+      ASSERT_DOUBLE_EQ(writable.yllcorner, dem.yllcorner + dem.cellsize);
+      writable(0, 0) = 42.0;
+      ASSERT_EQ(dem(1, 2), 42.0);
+
+      // Sub-windows behave like a raster holding a copy of the window
+      RasterView sub  = view.subView(RasterWindow{2, 1, 4, 5});
+      Raster     copy = Raster(sub);
+      ASSERT_EQ(copy.nRows, 4);
+      ASSERT_EQ(copy.nCols, 5);
+      ASSERT_DOUBLE_EQ(copy.xllcorner, dem.xllcorner + dem.cellsize);
+      for (size_t r = 0; r < copy.nRows; r++)
+         for (size_t c = 0; c < copy.nCols; c++)
+            ASSERT_EQ(sub(r, c), buffer[(r + 2) * stride + c + 1]);
+      ASSERT_EQ(Raster::ComputeSlopeZevenbergenThorne(sub).data, copy.ComputeSlope(Raster::ZevenbergenThorne).data);
+      ASSERT_DOUBLE_EQ(sub.GetAverage(7, 1.5 * dem.cellsize), copy.GetAverage(7, 1.5 * dem.cellsize));
+      ASSERT_THROW(view.subView(RasterWindow{dem.nRows, 0, 1, 1}), std::invalid_argument);
+   }
+
+   TEST(Raster, RasterFactories)
+   {
+      auto   path = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/7x3_NODATA.dem");
+      Raster dem(path.string());
+      Raster ref = Raster::fillLike(dem, 2.5, true);
+
+      Raster empty = Raster::emptyLike(dem);
+      ASSERT_EQ(empty.nData, dem.nData);
+      ASSERT_EQ(empty.data.size(), dem.nData);
+      ASSERT_DOUBLE_EQ(empty.yllcorner, dem.yllcorner);
+      ASSERT_DOUBLE_EQ(empty.height, dem.height);
+
+      // Reused buffers keep their storage
+      Raster out = Raster::fillLike(dem, 0.0, false);
+      out.data.reserve(2 * dem.nData);
+      const double *storage = out.data.data();
+      out.assignLike(dem, 2.5, true);
+      ASSERT_EQ(out.data.data(), storage);
+      ASSERT_EQ(out.data, ref.data);
+
+      Raster small(RasterView(dem).subView(RasterWindow{0, 0, 2, 2}));
+      small.resizeLike(dem);
+      ASSERT_EQ(small.nRows, dem.nRows);
+      ASSERT_EQ(small.data.size(), dem.nData);
+
+      // Filling a raster from itself, and from a window of another one
+      dem.assignLike(dem, 2.5, true);
+      ASSERT_EQ(dem.data, ref.data);
+
+      Raster part = Raster::fillLike(ref.view(RasterWindow{1, 1, 3, 2}), -1.0, true);
+      ASSERT_EQ(part.nRows, 3);
+      ASSERT_EQ(part.nCols, 2);
+      for (size_t r = 0; r < part.nRows; r++)
+         for (size_t c = 0; c < part.nCols; c++)
+            ASSERT_EQ(part(r, c), ref(r + 1, c + 1) == ref.nodata_value ? ref.nodata_value : -1.0);
+
+      // Metadata alone
+      BasicRaster<int16_t> meta = BasicRaster<int16_t>::fromMetadata(4, 3, 10, 20, 0.5, -1, 7);
+      ASSERT_EQ(meta.nRows, 4);
+      ASSERT_EQ(meta.nCols, 3);
+      ASSERT_DOUBLE_EQ(meta.yllcorner, 20);
+      ASSERT_DOUBLE_EQ(meta.width, 1.5);
+      ASSERT_DOUBLE_EQ(meta.height, 2);
+      ASSERT_DOUBLE_EQ(meta.nodata_value, -1);
+      ASSERT_EQ(meta.data, std::vector<int16_t>(12, 7));
+   }
+
    TEST(Raster, assertAgreeDim)
    {
       auto cwd = fs::current_path();
@@ -322,4 +1059,49 @@ namespace KiLib
          ASSERT_TRUE(std::find(inds.begin(), inds.end(), i) != inds.end());
       }
    }
+
+   TEST(Raster, ValidityMask)
+   {
+      // Sizes around word and block boundaries, with cell types of every width
+      std::mt19937_64 gen(9);
+      for (size_t nCols : {1, 7, 64, 129, 1500})
+      {
+         const size_t                nRows = 70001 / nCols + 3;
+         BasicRaster<float>          a     = BasicRaster<float>::fromMetadata(nRows, nCols, 0, 0, 1, -1);
+         BasicRaster<uint8_t>        b     = BasicRaster<uint8_t>::fromMetadata(nRows, nCols, 0, 0, 1, 255);
+         std::bernoulli_distribution missing(0.2);
+         for (size_t i = 0; i < a.nData; i++)
+         {
+            a(i) = missing(gen) ? a.nodata_value : 2.5f;
+            b(i) = missing(gen) ? b.nodata_value : 3;
+         }
+
+         const ValidityMask  mask = ValidityMask(a.view()) & ValidityMask(b.view());
+         std::vector<size_t> expected;
+         for (size_t i = 0; i < a.nData; i++)
+         {
+            ASSERT_EQ(mask.test(i), a(i) != a.nodata_value && b(i) != b.nodata_value);
+            if (mask.test(i))
+               expected.push_back(i);
+         }
+         ASSERT_EQ(mask.count(), expected.size());
+         ASSERT_EQ(mask.indices(), expected);
+         std::vector<size_t> visited;
+         mask.forEach([&](size_t ind) { visited.push_back(ind); });
+         ASSERT_EQ(visited, expected);
+
+         // Strided views of a window give the mask of the window
+         const RasterWindow window{nRows / 3, nCols / 3, nRows / 2, nCols - nCols / 3};
+         const ValidityMask sub(a.view(window));
+         ASSERT_EQ(sub.nData, window.nRows * window.nCols);
+         for (size_t i = 0; i < sub.nData; i++)
+            ASSERT_EQ(sub.test(i), a(window.row + i / window.nCols, window.col + i % window.nCols) != a.nodata_value);
+      }
+
+      ValidityMask all(3, 50, true);
+      ASSERT_EQ(all.count(), 150);
+      ASSERT_EQ(all.words().back() >> (150 % 64), 0);
+      ASSERT_EQ((all & ValidityMask(3, 50, false)).count(), 0);
+      ASSERT_THROW(all &= ValidityMask(50, 3, true), std::invalid_argument);
+   }
 } // namespace KiLib
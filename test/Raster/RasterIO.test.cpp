@@ -18,9 +18,13 @@
  */
 
 
+#include <KiLib/Raster/MappedRaster.hpp>
 #include <KiLib/Raster/Raster.hpp>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
 #include <numeric>
 #include <spdlog/spdlog.h>
 
@@ -196,4 +200,415 @@ namespace KiLib
 
       fs::current_path(cwd);
    }
+
+   TEST(Raster, TiledTiff)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+
+      // 16x16 DEFLATE tiles, the right and top tiles only partially overlap the raster
+      Raster tif((path / "37x21_tiled.tif").string());
+      Raster dem((path / "37x21_tiled.dem").string());
+
+      ASSERT_EQ(tif.nCols, 37);
+      ASSERT_EQ(tif.nRows, 21);
+      ASSERT_DOUBLE_EQ(tif.xllcorner, dem.xllcorner);
+      ASSERT_DOUBLE_EQ(tif.yllcorner, dem.yllcorner);
+      ASSERT_EQ(tif.data, dem.data);
+   }
+
+   TEST(Raster, StripedTiff)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+
+      // LZW strips of 4 rows, the last strip only holds 3
+      Raster tif((path / "29x23_strips.tif").string());
+      Raster dem((path / "29x23_strips.dem").string());
+
+      ASSERT_EQ(tif.nCols, 29);
+      ASSERT_EQ(tif.nRows, 23);
+      ASSERT_DOUBLE_EQ(tif.xllcorner, dem.xllcorner);
+      ASSERT_DOUBLE_EQ(tif.yllcorner, dem.yllcorner);
+      ASSERT_EQ(tif.data, dem.data);
+   }
+
+   TEST(Raster, CompressedTiffOutput)
+   {
+      auto   path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+      auto   out  = path / "37x21_compressed_comparison.tif";
+      Raster dem((path / "37x21_tiled.dem").string());
+
+      std::vector<TiffOptions> options(6);
+      options[0].compression = TiffOptions::Deflate;
+      options[1].compression = TiffOptions::ZSTD;
+      options[1].level       = 9;
+      options[2].compression = TiffOptions::LZW;
+      options[2].tileSize    = 16;
+      options[3].compression = TiffOptions::Deflate;
+      options[3].tileSize    = 32;
+      options[3].float32     = true;
+      options[4].tileSize    = 16;
+      options[5].compression = TiffOptions::Deflate;
+      options[5].predictor   = false;
+
+      for (const auto &opt : options)
+      {
+         dem.writeToFile(out.string(), opt);
+         Raster cmp(out.string());
+         fs::remove(out);
+
+         ASSERT_EQ(cmp.nCols, dem.nCols);
+         ASSERT_EQ(cmp.nRows, dem.nRows);
+         ASSERT_DOUBLE_EQ(cmp.xllcorner, dem.xllcorner);
+         ASSERT_DOUBLE_EQ(cmp.yllcorner, dem.yllcorner);
+         ASSERT_EQ(cmp.data, dem.data);
+      }
+
+      // Integer rasters use the horizontal predictor
+      BasicRaster<int16_t> ints(dem);
+      TiffOptions          opt;
+      opt.compression = TiffOptions::Deflate;
+      ints.writeToFile(out.string(), opt);
+      BasicRaster<int16_t> cmp(out.string());
+      fs::remove(out);
+      ASSERT_EQ(cmp.data, ints.data);
+   }
+
+   TEST(Raster, DEMWhitespace)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/");
+      auto out  = path / "crlf_comparison.asc";
+
+      // CRLF line endings, tabs and repeated separators
+      std::ofstream file(out, std::ios::binary);
+      file << "ncols 3\r\nnrows 2\r\nxllcorner 1.5\r\nyllcorner -2\r\ncellsize 0.5\r\nNODATA_value -9999\r\n"
+           << "1.25\t 2e2  -9999\r\n"
+           << "  4 5.5\t6";
+      file.close();
+
+      Raster dem(out.string());
+      fs::remove(out);
+
+      ASSERT_EQ(dem.nRows, 2);
+      ASSERT_EQ(dem.nCols, 3);
+      ASSERT_DOUBLE_EQ(dem.yllcorner, -2.0);
+      ASSERT_EQ(dem.data, std::vector<double>({4.0, 5.5, 6.0, 1.25, 200.0, -9999.0}));
+
+      // Windows over rows that end right after their last value
+      file.open(out, std::ios::binary);
+      file << "ncols 3\nnrows 3\nxllcorner 0\nyllcorner 0\ncellsize 1\nNODATA_value -9999\n"
+           << "1 2 3\n4 5 6\n7 8 9";
+      file.close();
+
+      Raster part(out.string(), RasterWindow{0, 1, 2, 0});
+      fs::remove(out);
+
+      ASSERT_EQ(part.nRows, 2);
+      ASSERT_EQ(part.nCols, 2);
+      ASSERT_EQ(part.data, std::vector<double>({8.0, 9.0, 5.0, 6.0}));
+   }
+
+   TEST(Raster, DEMGoldenOutput)
+   {
+      auto path   = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/");
+      auto golden = path / "9x7_golden.dem";
+      auto out    = path / "9x7_golden_comparison.dem";
+
+      // Cells of 9x7_golden.dem, rows counted from the top. The file was written by the per-cell writer toDEM
+      // replaced and holds negative values, values rounding to -0 and nodata.
+      auto cell = [](size_t row, size_t col) -> double
+      {
+         const size_t i = row * 7 + col;
+         if (i % 11 == 3)
+            return -9999;
+         if (i % 13 == 5)
+            return -1e-9 * static_cast<double>(i % 7 + 1);
+         return static_cast<double>(static_cast<long>(i * 7919 % 20011) - 10000) / 3.0;
+      };
+      // Writes a raster whose rows (from the top) are the given rows of the golden file
+      auto write = [&](const std::vector<size_t> &rows)
+      {
+         const size_t nRows = rows.size();
+         Raster       r     = Raster::fromMetadata(nRows, 7, 100.5, -20.25, 0.5, -9999);
+         for (size_t row = 0; row < nRows; row++)
+            for (size_t col = 0; col < 7; col++)
+               r(nRows - row - 1, col) = cell(rows[row], col);
+         r.writeToFile(out.string());
+
+         std::ifstream file(out, std::ios::binary);
+         std::string   bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+         file.close();
+         fs::remove(out);
+         return bytes;
+      };
+
+      std::ifstream     file(golden, std::ios::binary);
+      const std::string expect((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+      ASSERT_EQ(write({0, 1, 2, 3, 4, 5, 6, 7, 8}), expect);
+
+      // More rows than toDEM formats in one batch of 16 MiB (16 bytes per cell), picked from the golden file in a
+      // pattern that does not repeat with the batch size: the header with nrows changed, then those rows
+      const size_t        batch = (size_t{1} << 24) / (16 * 7);
+      std::vector<size_t> pick(2 * batch + 5);
+      for (size_t row = 0; row < pick.size(); row++)
+         pick[row] = (row / 5) % 9;
+
+      size_t body = 0;
+      for (int line = 0; line < 6; line++)
+         body = expect.find('\n', body) + 1;
+      std::vector<std::string> rows;
+      for (size_t pos = body; pos < expect.size(); pos = expect.find('\n', pos) + 1)
+         rows.push_back(expect.substr(pos, expect.find('\n', pos) + 1 - pos));
+      ASSERT_EQ(rows.size(), 9);
+
+      const size_t nrowsEnd = expect.find('\n', expect.find("nrows"));
+      std::string  tall     = "ncols 7\nnrows " + std::to_string(pick.size());
+      tall += expect.substr(nrowsEnd, body - nrowsEnd);
+      for (const size_t row : pick)
+         tall += rows[row];
+      ASSERT_TRUE(write(pick) == tall);
+   }
+
+   TEST(Raster, WindowedLoad)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+
+      // Windows that cross tile/strip boundaries, touch the edges and reach past them
+      const std::vector<RasterWindow> windows = {
+         {0, 0, 0, 0}, {3, 5, 10, 20}, {17, 20, 50, 50}, {0, 16, 1, 1}, {20, 0, 1, 0}, {5, 0, 16, 16}};
+
+      for (const auto stem : {"37x21_tiled", "29x23_strips"})
+      {
+         for (const auto ext : {".tif", ".dem"})
+         {
+            const auto file = (path / (std::string(stem) + ext)).string();
+            Raster     full(file);
+
+            for (const auto &win : windows)
+            {
+               Raster       part(file, win);
+               const size_t rows = std::min(win.nRows ? win.nRows : full.nRows, full.nRows - win.row);
+               const size_t cols = std::min(win.nCols ? win.nCols : full.nCols, full.nCols - win.col);
+
+               ASSERT_EQ(part.nRows, rows);
+               ASSERT_EQ(part.nCols, cols);
+               ASSERT_EQ(part.nData, rows * cols);
+               ASSERT_DOUBLE_EQ(part.xllcorner, full.xllcorner + win.col * full.cellsize);
+               ASSERT_DOUBLE_EQ(part.yllcorner, full.yllcorner + win.row * full.cellsize);
+               ASSERT_DOUBLE_EQ(part.width, cols * full.cellsize);
+               ASSERT_DOUBLE_EQ(part.height, rows * full.cellsize);
+
+               for (size_t r = 0; r < rows; r++)
+                  for (size_t c = 0; c < cols; c++)
+                     ASSERT_EQ(part(r, c), full(r + win.row, c + win.col));
+            }
+
+            ASSERT_THROW(Raster(file, RasterWindow{full.nRows, 0, 1, 1}), std::invalid_argument);
+            ASSERT_THROW(Raster(file, RasterWindow{0, full.nCols, 1, 1}), std::invalid_argument);
+         }
+      }
+
+      // Bounding boxes are widened to whole cells: x in [1003, 1009] covers columns 1 to 4, y in [2000.5, 2004]
+      // covers rows 0 and 1
+      auto   file = (path / "37x21_tiled.tif").string();
+      Raster full(file);
+      Raster box(file, Vec3(1003, 2000.5, 0), Vec3(1009, 2004, 0));
+
+      ASSERT_EQ(box.nCols, 4);
+      ASSERT_EQ(box.nRows, 2);
+      ASSERT_DOUBLE_EQ(box.xllcorner, 1002);
+      ASSERT_DOUBLE_EQ(box.yllcorner, 2000);
+      for (size_t r = 0; r < box.nRows; r++)
+         for (size_t c = 0; c < box.nCols; c++)
+            ASSERT_EQ(box(r, c), full(r, c + 1));
+
+      // Boxes reaching past the raster are clipped to it
+      Raster all(file, Vec3(0, 0, 0), Vec3(1e6, 1e6, 0));
+      ASSERT_EQ(all.data, full.data);
+      ASSERT_THROW(Raster(file, Vec3(0, 0, 0), Vec3(10, 10, 0)), std::invalid_argument);
+   }
+
+   TEST(Raster, NativeFormat)
+   {
+      auto   path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+      auto   out  = path / "37x21_native_comparison.kir";
+      Raster dem((path / "37x21_tiled.dem").string());
+
+      dem.writeToFile(out.string());
+
+      Raster kir(out.string());
+      ASSERT_EQ(kir.nCols, dem.nCols);
+      ASSERT_EQ(kir.nRows, dem.nRows);
+      ASSERT_DOUBLE_EQ(kir.xllcorner, dem.xllcorner);
+      ASSERT_DOUBLE_EQ(kir.yllcorner, dem.yllcorner);
+      ASSERT_DOUBLE_EQ(kir.cellsize, dem.cellsize);
+      ASSERT_DOUBLE_EQ(kir.nodata_value, dem.nodata_value);
+      ASSERT_EQ(kir.data, dem.data);
+
+      // Mapped cells are the file itself
+      {
+         MappedRaster mapped(out.string());
+         ASSERT_EQ(mapped.nData, dem.nData);
+         ASSERT_DOUBLE_EQ(mapped.yllcorner, dem.yllcorner);
+         ASSERT_EQ(std::vector<double>(mapped.data(), mapped.data() + mapped.nData), dem.data);
+         ASSERT_EQ(mapped(3, 7), dem(3, 7));
+         ASSERT_EQ(mapped.at(dem.nData - 1), dem.data.back());
+         ASSERT_THROW(mapped.at(dem.nData), std::out_of_range);
+         ASSERT_EQ(Raster::ComputeSlopeZevenbergenThorne(mapped).data, dem.ComputeSlope(Raster::ZevenbergenThorne).data);
+      }
+
+      // Windows and conversion to other cell types
+      Raster part(out.string(), RasterWindow{4, 6, 5, 8});
+      ASSERT_EQ(part.nRows, 5);
+      ASSERT_EQ(part.nCols, 8);
+      ASSERT_DOUBLE_EQ(part.xllcorner, dem.xllcorner + 6 * dem.cellsize);
+      for (size_t r = 0; r < part.nRows; r++)
+         for (size_t c = 0; c < part.nCols; c++)
+            ASSERT_EQ(part(r, c), dem(r + 4, c + 6));
+
+      BasicRaster<float> floats(out.string());
+      ASSERT_EQ(floats.data, BasicRaster<float>(dem).data);
+
+      // Nodata cells stay nodata in cell types that cannot hold -9999
+      BasicRaster<uint8_t> bytes(out.string());
+      ASSERT_EQ(bytes.nodata_value, 255);
+      ASSERT_EQ(bytes.data, BasicRaster<uint8_t>(dem).data);
+      ASSERT_LT(Raster::getValidIndices({&dem}).size(), dem.nData);
+      ASSERT_EQ(BasicRaster<uint8_t>::getValidIndices({&bytes}), Raster::getValidIndices({&dem}));
+
+      BasicRaster<int16_t> ints(dem);
+      ints.writeToFile(out.string());
+      BasicMappedRaster<int16_t> mappedInts(out.string());
+      ASSERT_EQ(std::vector<int16_t>(mappedInts.data(), mappedInts.data() + mappedInts.nData), ints.data);
+      ASSERT_EQ(Raster(out.string()).data, Raster(ints).data);
+
+      // Headers whose cells would be misaligned or reach past the end of the file are rejected. OpenMP threads are
+      // running, so death tests re-run the binary rather than fork it
+      ::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+      auto corrupt = [&](std::streamoff at, uint64_t value)
+      {
+         ints.writeToFile(out.string());
+         std::fstream file(out, std::ios::in | std::ios::out | std::ios::binary);
+         file.seekp(at);
+         file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+      };
+      corrupt(24, uint64_t{1} << 62);
+      ASSERT_EXIT(Raster(out.string()), ::testing::ExitedWithCode(EXIT_FAILURE), "");
+      ASSERT_EXIT(BasicMappedRaster<int16_t>(out.string()), ::testing::ExitedWithCode(EXIT_FAILURE), "");
+      corrupt(72, 4096 + 8);
+      ASSERT_EXIT(BasicMappedRaster<int16_t>(out.string()), ::testing::ExitedWithCode(EXIT_FAILURE), "");
+
+      fs::remove(out);
+   }
+
+   TEST(Raster, NativeFloatTiff)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+
+      // 5x5.tif is stored as float32, loading it as such must be lossless
+      BasicRaster<float> tif((path / "5x5.tif").string());
+      Raster             ref((path / "5x5.tif").string());
+
+      ASSERT_EQ(tif.nData, ref.nData);
+      ASSERT_DOUBLE_EQ(tif.nodata_value, ref.nodata_value);
+      for (size_t i = 0; i < ref.nData; i++)
+         ASSERT_EQ(static_cast<double>(tif(i)), ref(i));
+
+      tif.writeToFile((path / "5x5_float_comparison.tif").string());
+      BasicRaster<float> cmp((path / "5x5_float_comparison.tif").string());
+      fs::remove(path / "5x5_float_comparison.tif");
+
+      ASSERT_EQ(tif.data, cmp.data);
+      ASSERT_DOUBLE_EQ(tif.xllcorner, cmp.xllcorner);
+      ASSERT_DOUBLE_EQ(tif.yllcorner, cmp.yllcorner);
+   }
+
+   TEST(Raster, NativeIntegerRoundTrip)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/ComputeSlope/");
+
+      // 7x3.dem has a nodata value of -9999, which the cells cannot hold
+      BasicRaster<uint8_t> classes(Raster((path / "7x3.dem").string()));
+      ASSERT_EQ(classes.nodata_value, 255);
+
+      for (const std::string ext : {".tif", ".asc"})
+      {
+         auto out = path / ("7x3_uint8_comparison" + ext);
+         classes.writeToFile(out.string());
+         BasicRaster<uint8_t> cmp(out.string());
+         fs::remove(out);
+
+         ASSERT_EQ(classes.data, cmp.data);
+         ASSERT_EQ(cmp.nRows, 7);
+         ASSERT_EQ(cmp.nCols, 3);
+         ASSERT_EQ(cmp.nodata_value, 255);
+      }
+   }
+
+   TEST(Raster, NarrowCellNodata)
+   {
+      auto path = fs::path(std::string(TEST_DIRECTORY) + "/TIFF/");
+
+      // Every cell of ref that is nodata must be nodata in rast, the others saturate to the range of T and stay off
+      // its nodata value
+      auto check = [](const Raster &ref, const auto &rast, double nodata)
+      {
+         using T = typename std::decay_t<decltype(rast)>::value_type;
+         ASSERT_EQ(rast.nodata_value, nodata);
+         ASSERT_EQ(rast.nData, ref.nData);
+         for (size_t i = 0; i < ref.nData; i++)
+         {
+            if (ref(i) == ref.nodata_value)
+            {
+               ASSERT_EQ(rast(i), nodata);
+               continue;
+            }
+            const double expect = std::clamp(
+               std::trunc(ref(i)), double(std::numeric_limits<T>::lowest()), double(std::numeric_limits<T>::max()));
+            ASSERT_EQ(rast(i), expect == nodata ? expect - 1 : expect);
+         }
+      };
+
+      for (const auto ext : {".dem", ".tif"})
+      {
+         const auto file = (path / (std::string("29x23_strips") + ext)).string();
+         Raster     ref(file);
+         ASSERT_EQ(ref.nodata_value, -9999);
+         ASSERT_EQ(Raster::getValidIndices({&ref}).size(), ref.nData - 61);
+
+         // -9999 is replaced by the largest value of unsigned types, and kept by the others
+         check(ref, BasicRaster<uint8_t>(file), 255);
+         check(ref, BasicRaster<uint16_t>(file), 65535);
+         check(ref, BasicRaster<int16_t>(file), -9999);
+         check(ref, BasicRaster<uint8_t>(ref), 255);
+         check(ref, BasicRaster<uint16_t>(ref), 65535);
+
+         BasicRaster<uint8_t> bytes(file);
+         ASSERT_EQ(BasicRaster<uint8_t>::getValidIndices({&bytes}), Raster::getValidIndices({&ref}));
+      }
+
+      // Values out of range of the cells saturate, and stay off nodata values at the ends of the range
+      Raster big = Raster::fromMetadata(1, 6, 0, 0, 1, -9999, 0);
+      big.data   = {-9999, -1e300, 1e300, 255, 300.5, std::nan("")};
+      ASSERT_EQ(BasicRaster<uint8_t>(big).data, std::vector<uint8_t>({255, 0, 254, 254, 254, 255}));
+      ASSERT_EQ(BasicRaster<int16_t>(big).data, std::vector<int16_t>({-9999, -32768, 32767, 255, 300, -9999}));
+      big.nodata_value = 300;
+      ASSERT_EQ(BasicRaster<int16_t>(big).data, std::vector<int16_t>({-9999, -32768, 32767, 255, 301, 300}));
+
+      BasicRaster<float> floats(big);
+      ASSERT_EQ(floats.data[1], std::numeric_limits<float>::lowest());
+      ASSERT_EQ(floats.data[2], std::numeric_limits<float>::max());
+
+      // Writing to narrower samples goes through the same conversion, nodata included
+      auto out = path / "1x6_float32_comparison.tif";
+      big.nodata_value = -1e300;
+      TiffOptions opt;
+      opt.float32 = true;
+      big.writeToFile(out.string(), opt);
+      Raster written(out.string());
+      fs::remove(out);
+      ASSERT_EQ(written.nodata_value, std::numeric_limits<float>::lowest());
+      ASSERT_EQ(written.data[1], written.nodata_value);
+      ASSERT_EQ(written.data[0], -9999);
+      ASSERT_EQ(written.data[2], std::numeric_limits<float>::max());
+   }
 } // namespace KiLib